@@ -16,9 +16,13 @@
 #pragma GCC diagnostic pop
 #pragma GCC diagnostic pop
 
+#include <QStringList>
+#include <QString>
+#include <QSet>
+
 class QMediaPlayer;
-class QMediaPlaylist;
 class QUrl;
+class Playlist;
 
 namespace Astoria
 {
@@ -35,7 +39,10 @@ namespace Astoria
                 void init();
                 void deInit();
 
-                extern QMediaPlaylist *playlist;
+                void addFiles(const QStringList &paths);
+                void removeFiles(const QSet<QString> &paths);
+
+                extern ::Playlist *playlist;
         }
 
         namespace UI
@@ -48,10 +55,12 @@ namespace Astoria
         void deInit();
 
         QMediaPlayer *getAudioInstance();
-        QMediaPlaylist *getPlaylistInstance();
+        ::Playlist *getPlaylistInstance();
 
         QUrl getCurrentSong();
         TagLib::FileRef getCurrentTag();
+
+        bool benchmarking();
 }
 
 #endif // ASTORIA_NAMESPACE_HPP
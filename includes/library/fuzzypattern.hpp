@@ -0,0 +1,45 @@
+#ifndef FUZZYPATTERN_HPP
+#define FUZZYPATTERN_HPP
+
+#include <QString>
+#include <QHash>
+
+/**
+ * A word to look for in text while allowing for typos, e.g. so that "beatels" still finds
+ * "The Beatles".
+ *
+ * This is Myers' bit-parallel algorithm: the column of the edit distance table for each
+ * character of the text is held as bit vectors, one bit per character of the word, so a
+ * word of up to 64 characters takes a handful of integer operations per character of text,
+ * rather than a loop over the word. Longer words only have their first 64 characters
+ * looked for.
+ */
+class FuzzyPattern
+{
+public:
+        explicit FuzzyPattern(const QString &word);
+
+        int length() const
+        { return size; }
+
+        int maxErrors() const;
+        int distance(const QChar *text, int textLength) const;
+
+        static constexpr int maxLength = 64;
+
+private:
+        quint64 mask(QChar character) const
+        {
+                const ushort unicode = character.unicode();
+                return unicode < 128 ? ascii[unicode] : other.value(unicode);
+        }
+
+        int size;
+
+        // For each character, which positions of the word it's at. Normalized text is nearly
+        // all ASCII, which gets a table of its own.
+        quint64 ascii[128];
+        QHash<ushort, quint64> other;
+};
+
+#endif // FUZZYPATTERN_HPP
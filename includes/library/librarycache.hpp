@@ -0,0 +1,65 @@
+#ifndef LIBRARYCACHE_HPP
+#define LIBRARYCACHE_HPP
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QFile>
+#include <QList>
+
+#include "includes/library/librarystore.hpp"
+#include "includes/library/song.hpp"
+
+/**
+ * A binary copy of the library that's kept on disk, so that it doesn't have to be rebuilt
+ * from the audio files every time the program starts.
+ *
+ * The file is memory mapped rather than read, and each song is stored along with the size
+ * and modification time its file had when it was read. A scan can then check whether a
+ * file has changed since, and only read the ones that have.
+ *
+ * The format is a header (magic, version, song count, and which of the properties that
+ * are only read when asked for the songs have) followed by one record per song. All
+ * integers are stored little endian, and strings as a 32 bit length followed by that many
+ * bytes of UTF-8.
+ */
+class LibraryCache
+{
+public:
+        explicit LibraryCache(const QString &fileName = defaultLocation());
+        ~LibraryCache();
+
+        LibraryCache(const LibraryCache &) = delete;
+        LibraryCache &operator=(const LibraryCache &) = delete;
+
+        static QString defaultLocation();
+        static bool save(const QString &fileName, const LibraryStore &songs);
+
+        bool open();
+
+        int count() const
+        { return offsets.size(); }
+
+        Song::Properties properties() const
+        { return storedProperties; }
+
+        QList<Song> songs() const;
+
+        bool isUpToDate(const QString &path, qint64 size, qint64 modified) const;
+        Song song(const QString &path) const;
+
+private:
+        Song read(qint64 offset) const;
+
+        QFile file;
+        const uchar *data;
+        qint64 length;
+        Song::Properties storedProperties;
+
+        // Where each song's record starts in the file, both in the order they were saved
+        // in, and by path.
+        QVector<qint64> offsets;
+        QHash<QString, qint64> records;
+};
+
+#endif //LIBRARYCACHE_HPP
@@ -0,0 +1,44 @@
+#ifndef LIBRARYCOLUMNS_HPP
+#define LIBRARYCOLUMNS_HPP
+
+#include <QVariant>
+
+#include "includes/library/librarystore.hpp"
+
+/**
+ * A column that the library can be shown with.
+ *
+ * Each column reads its field straight out of the store, so showing a cell is a call
+ * through a function pointer rather than looking anything up by name.
+ *
+ * Columns showing metadata that's only read when asked for name the property they need,
+ * which only has to be read (and stored) while the column is shown.
+ */
+struct LibraryColumn
+{
+        const char *header;
+        bool shownByDefault;
+
+        // The metadata the column needs to be read, if it isn't read for every song.
+        Song::Property property;
+
+        // The field the column is sorted by.
+        LibraryStore::Field sortKey;
+
+        // The field as it's stored (for the edit and user roles), and as it's shown to the
+        // user (for the display role).
+        QVariant (*value)(const LibraryStore &library, int record);
+        QVariant (*display)(const LibraryStore &library, int record);
+};
+
+namespace LibraryColumns
+{
+        /**
+         * Every column there is, in the order they're shown in when they're first shown.
+         * Adding a column is a matter of adding it to the table in librarycolumns.cpp.
+         */
+        extern const LibraryColumn all[];
+        extern const int count;
+}
+
+#endif // LIBRARYCOLUMNS_HPP
@@ -0,0 +1,33 @@
+#ifndef LIBRARYDELTA_HPP
+#define LIBRARYDELTA_HPP
+
+#include <QStringList>
+#include <QMetaType>
+#include <QList>
+
+#include "includes/library/song.hpp"
+
+/**
+ * What's changed in the library's directories, either since they were last looked at (see
+ * LibraryWatcher), or compared against the library (see MusicScanner::setKnownFiles()).
+ */
+struct LibraryDelta
+{
+        // Files that were added or changed, read again. Whether each one is new is up to the
+        // library, as it's the one that knows what it already has.
+        QList<Song> songs;
+
+        // Files, and whole directories, that have gone (or been moved out of the library).
+        QStringList removed;
+        QStringList removedDirectories;
+
+        // Directories that changes were lost for, which have to be scanned again.
+        QStringList rescan;
+
+        bool isEmpty() const
+        { return songs.isEmpty() && removed.isEmpty() && removedDirectories.isEmpty() && rescan.isEmpty(); }
+};
+
+Q_DECLARE_METATYPE(LibraryDelta)
+
+#endif // LIBRARYDELTA_HPP
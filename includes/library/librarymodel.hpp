@@ -2,27 +2,36 @@
 #define LIBRARY_HPP
 
 #include <QAbstractTableModel>
-#include <QMediaPlaylist>
-
+#include <QSharedPointer>
+#include <QBitArray>
+#include <QMediaPlayer>
+#include <QPersistentModelIndex>
+#include <QPointer>
+#include <QTimer>
+#include <QPair>
+#include <QHash>
+#include <QSet>
+
+#include "includes/library/librarycolumns.hpp"
+#include "includes/library/librarysorter.hpp"
+#include "includes/library/librarystore.hpp"
+#include "includes/library/librarywatcher.hpp"
+#include "includes/library/searchindex.hpp"
 #include "includes/library/song.hpp"
 
+class LibraryCache;
+class MusicScanner;
+
 /**
  * TODO: Change most of this.
  *
  *  - There should be a playlist class that holds information on the current playlist.
- *  - The scanner should provide a list containing new elements (While checking the current
- *    library for any duplicates).
- *    - This should help in adding the new elements, and only the new elements, to the
- *      playlist.
  *  - The library should only be used as a model, not a controller of logic.
  *
  * FEATURES:
  *  - MenuBar
  *    - Choice of highlighting currently playing media (or some icon).
  *    - Choice of view follows playing media.
- *  - Right Click Menu
- *  - Both
- *    - Remove Item from library
  *
  */
 
@@ -32,6 +41,7 @@ Q_OBJECT
 
 signals:
         void libraryUpdated();
+        void scanningChanged(bool scanning);
 
 public:
         explicit LibraryModel();
@@ -40,32 +50,136 @@ public:
         int rowCount(const QModelIndex &parent = QModelIndex()) const Q_DECL_OVERRIDE;
         int columnCount(const QModelIndex &parent = QModelIndex()) const Q_DECL_OVERRIDE;
 
+        bool canFetchMore(const QModelIndex &parent) const Q_DECL_OVERRIDE;
+        void fetchMore(const QModelIndex &parent) Q_DECL_OVERRIDE;
+
         bool setData(const QModelIndex &index, const QVariant &value, int role) Q_DECL_OVERRIDE;
+        bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex()) Q_DECL_OVERRIDE;
 
         QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const Q_DECL_OVERRIDE;
         QVariant headerData(int section, Qt::Orientation orientation, int role) const Q_DECL_OVERRIDE;
 
         Qt::ItemFlags flags(const QModelIndex &index) const Q_DECL_OVERRIDE;
 
+        bool isColumnShown(int column) const;
+        void setColumnShown(int column, bool shown);
+
         void scanDirectory(QString &directory);
         void indexMightBeUpdated(const QModelIndex &index);
+        void removeSongs(const QModelIndexList &indexes);
 
         const QUrl get(int row) const;
 
-        const Song &songAt(int row) const
-        { return library[row]; }
+        Song songAt(int row) const
+        { return library.song(rows()[row]); }
 
 public slots:
         void openDirectory();
         void updateLibrary(QList<Song>);
         void sortByColumn(int column);
+        void sortByAlbum();
+        void setFilter(const QString &text);
         void updateMetadata();
+        void updateProperties(QVector<int> records, QList<Song> songs, int properties);
+        void refineDurations(QStringList paths);
+        void applyDelta(LibraryDelta delta);
+        void saveCache();
+        void rescanLibrary();
+
+        void pauseScan();
+        void resumeScan();
+        void cancelScan();
+        void playbackStateChanged(QMediaPlayer::State state);
+
+private slots:
+        void scanStopped();
 
 private:
-        int rows;
-        QList<QString> supportedFormats;
+        QStringList supportedFormats;
+
+        // The scan that's running, if there is one.
+        QPointer<MusicScanner> scanner;
+        MusicScanner *createScanner(const QString &directory);
+        void startScanner();
+
+        // The directories waiting to be scanned once the scan that's running is done.
+        QStringList scanQueue;
+        void startScan(const QString &directory);
+
+        // The directories waiting to be rescanned once the scan that's running is done.
+        QStringList rescanQueue;
+        bool rescanNext();
+        bool rescanDirectory(const QString &directory);
+
+        // Keeps the library up to date with the directories it was scanned from.
+        LibraryWatcher *watcher;
+        void watchDirectory(const QString &directory);
+
+        LibraryStore library;
+
+        // The records in the order they're shown in, i.e. row i shows record order[i].
+        QVector<int> order;
+        LibrarySorter sorter;
+
+        // What the rows were last sorted by, which new songs are kept sorted by too. Empty
+        // until the user sorts the library, in which case new songs go at the end.
+        QVector<LibrarySorter::SortKey> sortKeys;
+
+        // While there's a filter, only the records matching it are shown, in the same order
+        // as they are in order, i.e. row i shows record filtered[i] instead.
+        SearchIndex search;
+        QString filter;
+        QBitArray matches;
+        QVector<int> filtered;
 
-        QList<Song> library;
+        // When nothing matches the filter exactly, the songs that nearly match it are shown
+        // instead, closest first, until the library is sorted again.
+        bool ranked;
+        QVector<quint8> distances;
+
+        void findMatches(bool fuzzy);
+
+        const QVector<int> &rows() const
+        { return filter.isEmpty() ? order : filtered; }
+
+        // Only the first fetched rows are shown, and the view asks for more as it's scrolled
+        // through them, so that a huge library doesn't cost any more to show than a small one.
+        int fetched;
+        void fetchTo(int count);
+
+        QVector<int> matching(const QVector<int> &records) const;
+
+        void insertRecords(QVector<int> &into, QVector<int> records, bool visible);
+        void mergeRecords(QVector<int> &into, const QVector<int> &records,
+                          const QVector<int> &positions, bool visible);
+        void moveSorted(QVector<int> &in, int from, bool visible);
+        void keepSorted(int row);
+        void removeRecords(QVector<int> &from, const QBitArray &records, bool visible);
+
+        void removeFromLibrary(const QVector<int> &records);
+        void compact();
+        void replaceRecords(const QVector<int> &records, const QList<Song> &songs);
+
+        // Every file in the library, both by its canonical path (to its record) and by its
+        // device and inode, so that checking if a song is already in the library doesn't
+        // mean checking every song in it.
+        QHash<QString, int> libraryPaths;
+        QSet<QPair<quint64, quint64>> libraryFiles;
+
+        void sortBy(const QVector<LibrarySorter::SortKey> &keys);
+
+        bool isInLibrary(const Song &song) const;
+        void addToIndex(const Song &song, int record);
+        void removeFromIndex(int record);
+        int recordOf(const QString &path) const;
+
+        // The library as it was last saved to disk. Scans use it to skip reading files
+        // that haven't changed.
+        QSharedPointer<LibraryCache> cache;
+
+        // Saves the library a while after it last changed, rather than every time the
+        // watcher catches a change, since saving means writing out the whole library.
+        QTimer saveTimer;
 
         enum SortType
         {
@@ -74,10 +188,18 @@ private:
         };
 
         SortType sort;
-        const QString &getColumnHeader(int column) const;
-        QList<QString> columnHeaders;
 
-        QModelIndex mightBeUpdated;
+        // The columns shown, as indexes into LibraryColumns::all, in the order they're shown.
+        QVector<int> columns;
+
+        const LibraryColumn &columnAt(int section) const
+        { return LibraryColumns::all[columns[section]]; }
+
+        Song::Properties shownProperties() const;
+        void loadProperties(Song::Properties properties);
+        void loadProperties(Song::Properties properties, const QVector<int> &records);
+
+        QPersistentModelIndex mightBeUpdated;
 };
 
 #endif //LIBRARY_HPP
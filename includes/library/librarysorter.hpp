@@ -0,0 +1,65 @@
+#ifndef LIBRARYSORTER_HPP
+#define LIBRARYSORTER_HPP
+
+#include <QCollator>
+#include <QVector>
+
+#include <memory>
+
+#include "includes/library/librarystore.hpp"
+
+class WorkStealingPool;
+
+/**
+ * Sorts the records of a library store.
+ *
+ * Comparing strings (and especially comparing them the way the user's locale expects them
+ * to be ordered) is slow, so for each field we work out, once, the rank of every record's
+ * value amongst all of the values in that field. Sorting is then just ordering records by
+ * integers. Sorting by several fields packs their ranks together into one integer key per
+ * record, which is sorted with a (parallel, for big libraries) LSD radix sort.
+ *
+ * The ranks are kept until the store changes, at which point invalidate() should be called.
+ * Records added since the ranks were worked out can still be compared with lessThan(),
+ * which looks at their values instead.
+ */
+class LibrarySorter
+{
+public:
+        struct SortKey
+        {
+                LibraryStore::Field field;
+                Qt::SortOrder order;
+        };
+
+        explicit LibrarySorter(const LibraryStore &t_library);
+        ~LibrarySorter();
+
+        void invalidate();
+
+        const QVector<quint32> &ranks(LibraryStore::Field field);
+
+        QVector<int> sort(const QVector<int> &records, const QVector<SortKey> &keys);
+
+        bool lessThan(int a, int b, const QVector<SortKey> &keys) const;
+
+private:
+        QVector<quint32> rankStrings(const StringPool &pool);
+        QVector<quint32> rankRecords(LibraryStore::Field field);
+        int compare(int a, int b, LibraryStore::Field field) const;
+
+        void radixSort(std::vector<quint64> &keys, std::vector<int> &records, int bits);
+        WorkStealingPool &workers();
+
+        const LibraryStore &library;
+        QCollator collator;
+
+        // For each field, the rank of each record's value, or nothing if they haven't
+        // been worked out yet.
+        QVector<QVector<quint32>> fieldRanks;
+
+        // Only started the first time a big enough sort comes along.
+        std::unique_ptr<WorkStealingPool> pool;
+};
+
+#endif // LIBRARYSORTER_HPP
@@ -0,0 +1,217 @@
+#ifndef LIBRARYSTORE_HPP
+#define LIBRARYSTORE_HPP
+
+#include <QBitArray>
+#include <QVector>
+#include <QString>
+
+#include "includes/library/stringpool.hpp"
+#include "includes/library/song.hpp"
+
+/**
+ * The songs in the library, stored a column at a time rather than a song at a time.
+ *
+ * Every field is its own array, indexed by record (a song's position in the store).
+ * Artists, albums and genres repeat a lot, so they're interned and stored as IDs into a
+ * string pool. Titles and paths are kept as UTF-8 in a single pool, and the year, track,
+ * disc, and duration are stored as integers.
+ *
+ * Songs can be added with append() and read back with song(), but anything reading a
+ * single field (e.g. to display or sort it) should use that field's accessor, as building
+ * a Song means decoding every one of its strings.
+ *
+ * Removing a song only marks its record as removed, so that every other record keeps its
+ * place. Removed records are left out when the store is saved, and are dropped for good by
+ * compact(), which moves the records after them down, and drops the paths and titles of
+ * removed and replaced records from the text pool.
+ *
+ * The metadata that's only read when asked for (see Song::Properties) is only stored for
+ * the properties that have been turned on with setProperties(); the rest have no column at
+ * all, and read as empty.
+ */
+class LibraryStore
+{
+public:
+        // The fields of a song that can be shown (and sorted) in the library.
+        enum Field
+        {
+                Title,
+                Artist,
+                Album,
+                Track,
+                Year,
+                Genre,
+                Duration,
+                Disc,
+                Composer,
+                Bpm,
+                Bitrate,
+                SampleRate,
+                Comment,
+                FieldCount,
+        };
+
+        int size() const
+        { return paths.size(); }
+
+        // How many records haven't been removed.
+        int count() const
+        { return size() - removedCount; }
+
+        void reserve(int count);
+
+        int append(const Song &song);
+        void replace(int record, const Song &song);
+        void remove(int record);
+        QVector<int> compact();
+        bool needsCompacting() const;
+
+        bool isRemoved(int record) const
+        { return record < removed.size() && removed.testBit(record); }
+
+        Song::Properties properties() const
+        { return storedProperties; }
+
+        void setProperties(Song::Properties properties);
+        void updateProperties(int record, const Song &song, Song::Properties properties);
+
+        Song song(int record) const;
+
+        QString path(int record) const
+        { return text.string(paths[record]); }
+
+        QString canonicalPath(int record) const
+        { return canonicalPaths[record] == 0 ? path(record) : text.string(canonicalPaths[record]); }
+
+        QString title(int record) const
+        { return text.string(titles[record]); }
+
+        QString artist(int record) const
+        { return artists.string(artistIds[record]); }
+
+        QString album(int record) const
+        { return albums.string(albumIds[record]); }
+
+        QString genre(int record) const
+        { return genres.string(genreIds[record]); }
+
+        int year(int record) const
+        { return years[record]; }
+
+        int track(int record) const
+        { return tracks[record]; }
+
+        int disc(int record) const
+        { return discs[record]; }
+
+        int duration(int record) const
+        { return static_cast<int>(durations[record]); }
+
+        // The file's size and modification time when it was read, to tell if it's changed.
+        qint64 fileSize(int record) const
+        { return sizes[record]; }
+
+        qint64 modifiedTime(int record) const
+        { return modifiedTimes[record]; }
+
+        QString composer(int record) const
+        { return composers.string(composerId(record)); }
+
+        QString comment(int record) const
+        { return comments.string(commentId(record)); }
+
+        int bpm(int record) const
+        { return record < bpms.size() ? bpms[record] : 0; }
+
+        int bitrate(int record) const
+        { return record < bitrates.size() ? bitrates[record] : 0; }
+
+        int sampleRate(int record) const
+        { return record < sampleRates.size() ? static_cast<int>(sampleRates[record]) : 0; }
+
+        // The interned strings, for anything that wants to work on IDs rather than strings.
+        quint32 artistId(int record) const
+        { return artistIds[record]; }
+
+        quint32 albumId(int record) const
+        { return albumIds[record]; }
+
+        quint32 genreId(int record) const
+        { return genreIds[record]; }
+
+        quint32 composerId(int record) const
+        { return record < composerIds.size() ? composerIds[record] : 0; }
+
+        quint32 commentId(int record) const
+        { return record < commentIds.size() ? commentIds[record] : 0; }
+
+        const StringPool &artistPool() const
+        { return artists; }
+
+        const StringPool &albumPool() const
+        { return albums; }
+
+        const StringPool &genrePool() const
+        { return genres; }
+
+        const StringPool &composerPool() const
+        { return composers; }
+
+        const StringPool &commentPool() const
+        { return comments; }
+
+        qint64 memoryUsage() const;
+
+private:
+        void set(int record, const Song &song);
+        void compactText();
+
+        bool isTextStale() const
+        { return staleText > 0 && staleText >= text.byteCount() / 2; }
+
+        qint64 textLength(int record) const;
+
+        // Titles and paths, which are mostly unique.
+        StringPool text;
+        StringPool artists;
+        StringPool albums;
+        StringPool genres;
+
+        QVector<quint32> paths;
+        // 0 when the canonical path is the same as the path.
+        QVector<quint32> canonicalPaths;
+        QVector<quint32> titles;
+        QVector<quint32> artistIds;
+        QVector<quint32> albumIds;
+        QVector<quint32> genreIds;
+
+        QVector<quint16> years;
+        QVector<quint16> tracks;
+        QVector<quint16> discs;
+        QVector<quint32> durations;
+
+        QVector<quint64> devices;
+        QVector<quint64> inodes;
+        QVector<qint64> sizes;
+        QVector<qint64> modifiedTimes;
+
+        // Only as long as the last record that's been removed.
+        QBitArray removed;
+        int removedCount = 0;
+
+        // How many bytes of the text pool are paths and titles that no record uses any more.
+        qint64 staleText = 0;
+
+        // The metadata that's only stored when it's been asked for. Each of these is either
+        // empty, or has an entry for every record.
+        Song::Properties storedProperties;
+        StringPool composers;
+        StringPool comments;
+        QVector<quint32> composerIds;
+        QVector<quint32> commentIds;
+        QVector<quint16> bpms;
+        QVector<quint16> bitrates;
+        QVector<quint32> sampleRates;
+};
+
+#endif // LIBRARYSTORE_HPP
@@ -10,6 +10,9 @@ class LibraryView : public QTableView
 {
 Q_OBJECT
 
+signals:
+        void removeRequested();
+
 public:
         explicit LibraryView(QWidget *parent = nullptr, QAbstractItemModel *library = nullptr);
         void setDelegate(int row, bool doHover);
@@ -17,6 +20,9 @@ public:
 public slots:
         void entry(const QModelIndex &);
 
+protected:
+        void keyPressEvent(QKeyEvent *event) Q_DECL_OVERRIDE;
+
 private:
         int currentIndex = -1;
         HoverDelegate hoverDelegate;
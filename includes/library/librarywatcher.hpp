@@ -0,0 +1,104 @@
+#ifndef LIBRARYWATCHER_HPP
+#define LIBRARYWATCHER_HPP
+
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QByteArray>
+#include <QThread>
+#include <QHash>
+#include <QList>
+#include <QSet>
+
+#include <atomic>
+#include <mutex>
+
+#include "includes/library/librarydelta.hpp"
+#include "includes/library/song.hpp"
+
+/**
+ * Watches the directories the library was scanned from, and passes on what's changed in
+ * them, so that the library keeps up with files being added, edited, or deleted while the
+ * player's running without scanning everything again.
+ *
+ * Every directory under a root is watched with inotify. Changes tend to come in bursts
+ * (e.g. copying an album in), so they're collected until nothing's changed for a moment,
+ * or until they've been waiting for a few seconds, and then only the files that changed
+ * are read, all in one delta.
+ *
+ * Where inotify isn't available, or the user's run out of watches, a root is polled
+ * instead: every so often its tree is walked, and each file's size and modification time
+ * are compared against the last walk.
+ */
+class LibraryWatcher : public QThread
+{
+Q_OBJECT
+
+signals:
+        void libraryChanged(LibraryDelta delta);
+
+public:
+        LibraryWatcher(const QStringList &nameFilters, QObject *parent = nullptr);
+        ~LibraryWatcher() Q_DECL_OVERRIDE;
+
+        void watch(const QString &directory);
+        void setProperties(Song::Properties t_properties);
+        void stop();
+
+        void run() Q_DECL_OVERRIDE;
+
+private:
+        struct FileState
+        {
+                qint64 size;
+                qint64 modified;
+        };
+
+        typedef QHash<QByteArray, FileState> Snapshot;
+
+        void wake();
+        void addRoot(const QByteArray &root);
+
+        bool watchTree(const QByteArray &path, bool report);
+        void unwatchTree(const QByteArray &path);
+        void readEvents();
+
+        Snapshot snapshot(const QByteArray &root) const;
+        void pollRoots();
+
+        void changed(const QByteArray &path);
+        void flush();
+        int timeout() const;
+
+        bool isSupported(const char *name) const;
+
+        QSet<QByteArray> suffixes;
+        std::atomic<int> properties;
+
+        std::mutex rootsMutex;
+        QList<QByteArray> newRoots;
+        std::atomic<bool> stopping;
+
+        // Written to by other threads to wake run() up.
+        int wakePipe[2];
+
+        int inotifyFd;
+        QList<QByteArray> roots;
+        // The directory each watch is on.
+        QHash<int, QByteArray> watches;
+
+        // The roots being polled, as they were when they were last walked.
+        QHash<QByteArray, Snapshot> polled;
+        qint64 lastPoll;
+
+        // The files that have changed, which are read once things have been quiet for a
+        // moment.
+        QSet<QByteArray> pending;
+        QStringList removedDirectories;
+        QStringList rescan;
+        qint64 firstChange;
+        qint64 lastChange;
+
+        QElapsedTimer clock;
+};
+
+#endif // LIBRARYWATCHER_HPP
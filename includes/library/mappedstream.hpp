@@ -0,0 +1,69 @@
+#ifndef MAPPEDSTREAM_HPP
+#define MAPPEDSTREAM_HPP
+
+#include <QByteArray>
+
+// Taglib, at least on OSX, throws a couple of deprecated declaration warnings
+// which are annoying to see, and interfere with -Werror. This might not be a
+// good thing to do, but it solves this problem for now.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#pragma GCC diagnostic ignored "-Wnon-virtual-dtor"
+#include <tiostream.h>
+#pragma GCC diagnostic pop
+
+/**
+ * A read only stream over a file that's mapped into memory, for reading tags with.
+ *
+ * TagLib::FileStream reads files in lots of small blocks, each of which is a system call
+ * and a copy out of stdio's buffer. Reading from a mapping is just a copy straight out of
+ * the page cache, and the only system calls are the ones opening and mapping the file.
+ *
+ * Tags are almost always at the start or end of a file, so the kernel is told to read
+ * those ahead, and not to bother reading ahead anywhere else.
+ *
+ * If the file is truncated while it's mapped, reading past its new end raises SIGBUS, which
+ * takes the player down. Files in the library can be rewritten at any time (by the
+ * metadata editor, or a tagger), so this is only used to compare PrefetchedStream against
+ * when benchmarking; everything else reads through PrefetchedStream.
+ */
+class MappedStream : public TagLib::IOStream
+{
+public:
+        explicit MappedStream(TagLib::FileName file);
+        ~MappedStream() Q_DECL_OVERRIDE;
+
+        TagLib::FileName name() const Q_DECL_OVERRIDE;
+        TagLib::ByteVector readBlock(unsigned long length) Q_DECL_OVERRIDE;
+
+        // The stream is read only, so these do nothing.
+        void writeBlock(const TagLib::ByteVector &data) Q_DECL_OVERRIDE;
+        void insert(const TagLib::ByteVector &data, unsigned long start = 0,
+                    unsigned long replace = 0) Q_DECL_OVERRIDE;
+        void removeBlock(unsigned long start = 0, unsigned long length = 0) Q_DECL_OVERRIDE;
+        void truncate(long length) Q_DECL_OVERRIDE;
+
+        bool readOnly() const Q_DECL_OVERRIDE;
+        bool isOpen() const Q_DECL_OVERRIDE;
+
+        void seek(long offset, Position p = Beginning) Q_DECL_OVERRIDE;
+        long tell() const Q_DECL_OVERRIDE;
+        long length() Q_DECL_OVERRIDE;
+
+        // How much TagLib has read, which is all that gets paged in, give or take the pages
+        // around it.
+        qint64 bytesRead() const
+        { return count; }
+
+private:
+        QByteArray path;
+        bool opened;
+
+        const char *data;
+        long size;
+        long position;
+
+        qint64 count;
+};
+
+#endif // MAPPEDSTREAM_HPP
@@ -1,26 +1,183 @@
 #ifndef MUSICSCANNER_H
 #define MUSICSCANNER_H
 
-#include <QFileInfoList>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QByteArray>
 #include <QThread>
+#include <QVector>
+#include <QHash>
 #include <QList>
+#include <QSet>
 
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <mutex>
+
+#include "includes/library/librarydelta.hpp"
 #include "includes/library/song.hpp"
 
+class WorkStealingPool;
+class LibraryCache;
+
+/**
+ * Recursively scans a directory for songs.
+ *
+ * The directory tree is walked, and the tags of every supported file read, on a pool of
+ * worker threads that steal sub-trees (and batches of files) from each other, so that a
+ * single large directory doesn't end up being read by a single thread.
+ *
+ * By default every song found is passed on in a single list once the scan is done. With
+ * setBatching() the songs are instead streamed out while the scan is still running, in
+ * batches bounded by both a count and a time interval.
+ *
+ * Given a library cache, files that haven't changed since they were cached aren't read
+ * again, and the cached song is passed on instead.
+ *
+ * Given the files already in the library with setKnownFiles(), the scan is a rescan:
+ * only files that are new or have changed are read, and instead of passing on songs, a
+ * single delta of those songs and of the known files that weren't found is passed on at
+ * the end.
+ *
+ * Only the basic tags are read, unless setProperties() asks for more. With
+ * setReadStyle(TagLib::AudioProperties::Fast) only the files' headers are read for their
+ * durations, and once the scan is done the files whose durations are only estimates are
+ * passed on, so that they can be read properly in the background.
+ *
+ * Files are read as they're found, unless setOrder() asks for them to be read in the order
+ * they're laid out on the disk, which saves a spinning disk a lot of seeking.
+ *
+ * How many of the threads are reading at once is tuned while the scan runs, going by how
+ * quickly songs are being found. While setBackground() is on (e.g. while a song is playing)
+ * only one thread reads at a time, at idle I/O priority and a lower CPU priority, so that
+ * the scan doesn't get in the way. Scans can be paused, resumed, and cancelled from any
+ * thread.
+ */
 class MusicScanner : public QThread
 {
 Q_OBJECT
 
 signals:
         void passNewItems(QList<Song>);
+        void scanFinished(int songs, qint64 milliseconds);
+        void durationsEstimated(QStringList paths);
+        void deltaFound(LibraryDelta delta);
 
 public:
-        MusicScanner(QFileInfoList &);
+        enum Order
+        {
+                DirectoryOrder,
+                InodeOrder,
+                PhysicalOrder,
+        };
+
+        // A file that's already in the library, as it was when it was read.
+        struct KnownFile
+        {
+                qint64 size;
+                qint64 modified;
+        };
+
+        MusicScanner(const QString &directory, const QStringList &nameFilters,
+                     int threads = QThread::idealThreadCount());
+
+        void setBatching(int size, int milliseconds);
+        void setCache(QSharedPointer<const LibraryCache> t_cache);
+        void setProperties(Song::Properties t_properties);
+        void setReadStyle(TagLib::AudioProperties::ReadStyle style);
+        void setOrder(Order t_order);
+        void setKnownFiles(const QHash<QByteArray, KnownFile> &files);
+
+        static bool isRotational(const QString &path);
+
+        void pause();
+        void resume();
+        void cancel();
+        void setBackground(bool t_background);
 
         void run() Q_DECL_OVERRIDE;
 
 private:
-        QFileInfoList files;
+        struct ScheduledFile
+        {
+                QByteArray path;
+                // The inode, or the physical offset once schedule() has found it.
+                quint64 position;
+                // The order the file was found in, for comparing against.
+                int found;
+        };
+
+        void waitFor(WorkStealingPool &workers);
+        void schedule();
+
+        bool enter();
+        void leave();
+        void tune(double throughput);
+
+        void scanDirectory(const QByteArray &path, int worker);
+        void scanFiles(const QList<QByteArray> &paths);
+        bool isSupported(const char *name) const;
+
+        void songsFound(QList<Song> &songs);
+        void flush();
+
+        bool isUnchanged(const QByteArray &path);
+        void flushDelta();
+
+        QString root;
+        QSet<QByteArray> suffixes;
+        int threadCount;
+
+        int batchSize;
+        int batchInterval;
+
+        QSharedPointer<const LibraryCache> cache;
+        std::atomic<int> songsCached;
+
+        // When rescanning, the files that are already in the library, and whether each one
+        // has been found. A file can be found by more than one thread, through symbolic
+        // links or bind mounts, so the flags are atomic.
+        bool rescanning;
+        QHash<QByteArray, int> knownIndex;
+        QVector<KnownFile> knownFiles;
+        std::vector<std::atomic<char>> knownFound;
+        std::atomic<int> songsUnchanged;
+
+        Song::Properties properties;
+        TagLib::AudioProperties::ReadStyle readStyle;
+        Order order;
+
+        // Guards how many tasks can be reading at once. Tasks wait in enter() until there's
+        // room for them.
+        std::mutex gateMutex;
+        std::condition_variable gateChanged;
+        int active;
+        int concurrency;
+        int step;
+        double lastThroughput;
+        bool paused;
+        bool background;
+        std::atomic<bool> cancelled;
+
+        std::mutex scheduledMutex;
+        std::vector<ScheduledFile> scheduled;
+
+        WorkStealingPool *pool;
+        std::mutex foundMutex;
+        QList<Song> found;
+        // The files whose durations were only estimated, which are read again afterwards,
+        // and the first few files read, when benchmarking.
+        QStringList estimatedPaths;
+        QStringList benchmarkPaths;
+        std::atomic<int> songsScanned;
+        std::atomic<int> directoriesScanned;
+
+        // How many files were actually read, rather than taken from the cache, how much of
+        // them was read, and how much of that wasn't read ahead.
+        std::atomic<int> songsRead;
+        std::atomic<qint64> bytesRead;
+        std::atomic<qint64> bytesMissed;
 };
 
 #endif //MUSICSCANNER_H
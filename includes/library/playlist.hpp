@@ -1,20 +1,104 @@
 #ifndef PLAYLIST_HPP
 #define PLAYLIST_HPP
 
-#include <QMediaPlaylist>
+#include <QMediaPlayer>
+#include <QStringList>
+#include <QMultiHash>
+#include <QObject>
+#include <QString>
+#include <QSet>
 
-class Playlist : public QMediaPlaylist
+#include <random>
+
+/**
+ * The queue of songs to play, and which one is playing.
+ *
+ * The entries are kept in an implicit treap: a binary tree whose in-order walk is the
+ * queue, where an entry's position isn't stored but worked out from the sizes of the
+ * subtrees, and which is kept balanced by giving every entry a random priority. Inserting,
+ * removing, or moving any number of entries, or finding the entry at a position, is a
+ * matter of splitting and merging the tree in O(log n), rather than shifting every entry
+ * after them like a list does.
+ *
+ * Every entry knows its parent, so stepping to the next or previous entry walks the tree
+ * from the current one, which is O(1) amortized, and an entry's position is found by
+ * walking up to the root. Each file's entries are also kept by path, so jumping to a file
+ * or removing it doesn't mean looking through the queue.
+ *
+ * Given a player, the current entry is what the player plays, and the queue moves on to the
+ * next entry when a song finishes.
+ */
+class Playlist : public QObject
 {
 Q_OBJECT
 
 public:
-        explicit Playlist();
+        explicit Playlist(QObject *parent = nullptr);
+        ~Playlist() Q_DECL_OVERRIDE;
+
+        void setPlayer(QMediaPlayer *t_player);
+
+        int size() const
+        { return sizeOf(root); }
+
+        bool isEmpty() const
+        { return root == nullptr; }
+
+        QString at(int index) const;
+        QString current() const;
+        int currentIndex() const;
+
+        void append(const QStringList &paths);
+        void insert(int index, const QStringList &paths);
+        void playNext(const QStringList &paths);
+        void remove(int first, int count);
+        void removeFiles(const QSet<QString> &paths);
+        void move(int first, int count, int to);
+        void clear();
 
-        void next();
-        void previous();
+        bool setCurrentIndex(int index);
+        bool jumpTo(const QString &path);
+        bool next();
+        bool previous();
+
+private slots:
+        void mediaStatusChanged(QMediaPlayer::MediaStatus status);
 
 private:
+        struct Node
+        {
+                QString path;
+                quint32 priority;
+                int size;
+                Node *left;
+                Node *right;
+                Node *parent;
+        };
+
+        static int sizeOf(const Node *node)
+        { return node == nullptr ? 0 : node->size; }
+
+        static void update(Node *node);
+        static void resize(Node *node);
+        static Node *merge(Node *first, Node *second);
+        static void split(Node *node, int count, Node *&before, Node *&after);
+        static int position(const Node *node);
+        static Node *successor(Node *node);
+        static Node *predecessor(Node *node);
+
+        Node *nodeAt(int index) const;
+        Node *build(const QStringList &paths);
+        void release(Node *node);
+        void setCurrent(Node *node);
+
+        Node *root;
+        Node *currentNode;
+
+        // Every entry for each file.
+        QMultiHash<QString, Node *> entries;
 
+        std::mt19937 priorities;
+        QMediaPlayer *player;
 };
 
 #endif //PLAYLIST_HPP
@@ -0,0 +1,94 @@
+#ifndef PREFETCHEDSTREAM_HPP
+#define PREFETCHEDSTREAM_HPP
+
+#include <QByteArray>
+#include <QList>
+
+#include <memory>
+#include <vector>
+
+// Taglib, at least on OSX, throws a couple of deprecated declaration warnings
+// which are annoying to see, and interfere with -Werror. This might not be a
+// good thing to do, but it solves this problem for now.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#pragma GCC diagnostic ignored "-Wnon-virtual-dtor"
+#include <tiostream.h>
+#include <tbytevector.h>
+#pragma GCC diagnostic pop
+
+/**
+ * A read only stream over a file whose start and end have already been read into memory.
+ *
+ * Reading tags is mostly waiting on a couple of small reads at either end of each file, one
+ * after the other. prefetch() reads the ends of a whole batch of files at once instead, so
+ * that on a spinning disk or a cold cache the waits overlap rather than add up. With
+ * io_uring (when built with liburing) every read in the batch is in flight together;
+ * without it, they're read with pread() on whichever thread is scanning, and the overlap
+ * comes from the scanner's threads instead.
+ *
+ * Anything TagLib reads outside of the prefetched ends (e.g. when it has to look for the
+ * first frame of an MP3 after a large ID3v2 tag) is read from the file as usual.
+ *
+ * TagLib::ByteVectorStream would need the whole file in memory to have the right offsets
+ * and length, which is why this isn't one.
+ *
+ * Unlike a mapping, reading a file that's been truncated in the meantime just comes up
+ * short, so this is safe for reading files that may be being rewritten, e.g. by a tagger.
+ */
+class PrefetchedStream : public TagLib::IOStream
+{
+public:
+        ~PrefetchedStream() Q_DECL_OVERRIDE;
+
+        static std::vector<std::unique_ptr<PrefetchedStream>> prefetch(const QList<QByteArray> &paths);
+        static std::unique_ptr<PrefetchedStream> prefetch(const QByteArray &path);
+        static const char *engine();
+
+        TagLib::FileName name() const Q_DECL_OVERRIDE;
+        TagLib::ByteVector readBlock(unsigned long length) Q_DECL_OVERRIDE;
+
+        // The stream is read only, so these do nothing.
+        void writeBlock(const TagLib::ByteVector &data) Q_DECL_OVERRIDE;
+        void insert(const TagLib::ByteVector &data, unsigned long start = 0,
+                    unsigned long replace = 0) Q_DECL_OVERRIDE;
+        void removeBlock(unsigned long start = 0, unsigned long length = 0) Q_DECL_OVERRIDE;
+        void truncate(long length) Q_DECL_OVERRIDE;
+
+        bool readOnly() const Q_DECL_OVERRIDE;
+        bool isOpen() const Q_DECL_OVERRIDE;
+
+        void seek(long offset, Position p = Beginning) Q_DECL_OVERRIDE;
+        long tell() const Q_DECL_OVERRIDE;
+        long length() Q_DECL_OVERRIDE;
+
+        // How much TagLib has read, and how much of that wasn't prefetched.
+        qint64 bytesRead() const
+        { return count; }
+        qint64 bytesMissed() const
+        { return missed; }
+
+private:
+        explicit PrefetchedStream(const QByteArray &t_path);
+
+        static void readAll(std::vector<std::unique_ptr<PrefetchedStream>> &streams);
+#ifdef HAVE_LIBURING
+        static bool readAllUring(std::vector<std::unique_ptr<PrefetchedStream>> &streams);
+#endif
+
+        QByteArray path;
+        int descriptor;
+
+        long size;
+        long position;
+
+        // The start of the file, and the end of it, which starts at tailStart.
+        TagLib::ByteVector head;
+        TagLib::ByteVector tail;
+        long tailStart;
+
+        qint64 count;
+        qint64 missed;
+};
+
+#endif // PREFETCHEDSTREAM_HPP
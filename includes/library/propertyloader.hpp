@@ -0,0 +1,49 @@
+#ifndef PROPERTYLOADER_HPP
+#define PROPERTYLOADER_HPP
+
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+#include <QList>
+
+#include <atomic>
+#include <mutex>
+
+#include "includes/library/song.hpp"
+
+/**
+ * Reads some of the metadata that's only read when asked for (see Song::Properties) for
+ * songs that are already in the library, e.g. when the user starts showing a column that
+ * needs it.
+ *
+ * The files are read on a pool of threads, and what's been read is passed back in batches
+ * as it's read, so the column fills in while the user carries on using the library.
+ */
+class PropertyLoader : public QThread
+{
+Q_OBJECT
+
+signals:
+        void propertiesLoaded(QVector<int> records, QList<Song> songs, int properties);
+
+public:
+        PropertyLoader(const QVector<int> &t_records, const QStringList &t_paths,
+                       Song::Properties t_properties, int threads = QThread::idealThreadCount());
+
+        void run() Q_DECL_OVERRIDE;
+
+private:
+        void flush();
+
+        QVector<int> records;
+        QStringList paths;
+        Song::Properties properties;
+        int threadCount;
+        std::atomic<qint64> bytesRead;
+
+        std::mutex loadedMutex;
+        QVector<int> loadedRecords;
+        QList<Song> loadedSongs;
+};
+
+#endif // PROPERTYLOADER_HPP
@@ -0,0 +1,101 @@
+#ifndef SEARCHINDEX_HPP
+#define SEARCHINDEX_HPP
+
+#include <QBitArray>
+#include <QString>
+#include <QVector>
+#include <QHash>
+
+#include <memory>
+
+#include "includes/library/librarystore.hpp"
+
+class WorkStealingPool;
+
+/**
+ * An index of the titles, artists, and albums in a library store, for searching it as the
+ * user types.
+ *
+ * Strings are normalized (case folded, with accents and punctuation removed), and split
+ * into trigrams, i.e. every run of three characters. Each trigram has a sorted list of
+ * everything it appears in, so finding the songs containing a word means intersecting the
+ * lists for the word's trigrams instead of looking at every song.
+ *
+ * Titles are indexed by record. Artists and albums are interned, so they're indexed by ID,
+ * and each ID keeps a list of the records that use it.
+ *
+ * For when the user has made a typo, and nothing contains what they typed, the normalized
+ * strings are also kept so that every one of them can be fuzzy matched (see FuzzyPattern).
+ */
+class SearchIndex
+{
+public:
+        explicit SearchIndex(const LibraryStore &t_library);
+        ~SearchIndex();
+
+        void add(int record);
+        void remove(int record);
+        void remap(const QVector<int> &moved);
+
+        QBitArray find(const QString &query) const;
+        QVector<quint8> fuzzyFind(const QString &query) const;
+
+        void find(const QString &query, const QVector<int> &records, QBitArray &matches) const;
+        void fuzzyFind(const QString &query, const QVector<int> &records, QVector<quint8> &distances) const;
+
+        static QString normalize(const QString &text);
+
+        static constexpr quint8 noMatch = 255;
+
+private:
+        // Trigrams to the sorted IDs of whatever they appear in.
+        class TrigramIndex
+        {
+        public:
+                void insert(int id, const QString &normalized);
+                void erase(int id, const QString &normalized);
+                void remap(const QVector<int> &moved);
+
+                QVector<int> candidates(const QString &word) const;
+
+        private:
+                QHash<quint64, QVector<int>> postings;
+        };
+
+        // An interned field, indexed by string ID.
+        struct InternedField
+        {
+                TrigramIndex index;
+
+                // The normalized string, and the records using it, for each ID.
+                QVector<QString> strings;
+                QVector<QVector<int>> records;
+        };
+
+        static void addInterned(InternedField &field, const StringPool &pool, quint32 id,
+                                int record);
+        static void findInterned(const InternedField &field, const QString &word,
+                                 QBitArray &found);
+
+        QStringRef title(int record) const
+        { return titleText.midRef(titleStarts[record], titleLengths[record]); }
+
+        WorkStealingPool &workers() const;
+
+        const LibraryStore &library;
+
+        TrigramIndex titles;
+        InternedField artists;
+        InternedField albums;
+
+        // Every normalized title, one after another. A title that changes is added to the
+        // end again, rather than moving every title after it.
+        QString titleText;
+        QVector<int> titleStarts;
+        QVector<int> titleLengths;
+
+        // Fuzzy matching every title is worth spreading over a few threads.
+        mutable std::unique_ptr<WorkStealingPool> pool;
+};
+
+#endif // SEARCHINDEX_HPP
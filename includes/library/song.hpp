@@ -13,27 +13,90 @@
 #pragma GCC diagnostic pop
 
 #include <QString>
-#include <QMap>
 #include <QFileInfo>
 
+/**
+ * The metadata of a single song.
+ *
+ * A song is a plain value: it doesn't hold on to its file, and all of its members are
+ * implicitly shared or plain integers, so copying one around (through queued signals,
+ * the library, sorting, etc.) never touches the disk.
+ *
+ * Numbers are kept as numbers; formatting them for display is up to whoever displays them.
+ *
+ * Some metadata is only read when it's asked for, as it's only needed if the user has
+ * chosen to show it in the library. Which of it a song holds is up to whoever read it.
+ */
 class Song
 {
 public:
-        explicit Song(const QFileInfo &);
-        Song(const Song &other);
+        enum Property
+        {
+                Composer = 0x01,
+                Bpm = 0x02,
+                Comment = 0x04,
+                Bitrate = 0x08,
+                SampleRate = 0x10,
 
-        ~Song() = default;
+                // The duration as read from the whole file, for songs whose duration was
+                // only estimated from the file's headers (see TagLib::AudioProperties::Fast).
+                Duration = 0x20,
+        };
+        Q_DECLARE_FLAGS(Properties, Property)
 
-        const QMap<QString, QString> &getMetadata() const;
+        Song();
+        Song(const QFileInfo &, TagLib::IOStream &stream, Properties properties,
+             TagLib::AudioProperties::ReadStyle style, bool *durationEstimated = nullptr);
+
+        TagLib::FileRef open() const;
+
+        static QString formatDuration(int milliseconds);
+        static QString formatNumber(int number);
+        static QString formatBitrate(int kilobits);
+        static QString formatSampleRate(int hertz);
 
         QString filePath;
-        TagLib::FileRef file;
 
-        void updateMetadata();
+        QString title;
+        QString artist;
+        QString album;
+        QString genre;
+        int year;
+        int track;
+        int disc;
+        // In milliseconds.
+        int duration;
+
+        QString composer;
+        QString comment;
+        int bpm;
+        // In kb/s and Hz.
+        int bitrate;
+        int sampleRate;
+
+        // Used to tell if two songs are actually the same file, even when they're found
+        // through a symbolic link, or are hard links to each other.
+        QString canonicalPath;
+        quint64 device;
+        quint64 inode;
+
+        // Used to tell if the file has changed since it was last read.
+        qint64 size;
+        qint64 modified;
+
+        void updateMetadata(Properties properties = Properties(),
+                            TagLib::AudioProperties::ReadStyle style = TagLib::AudioProperties::Average);
+        void updateMetadata(TagLib::IOStream &stream, Properties properties,
+                            TagLib::AudioProperties::ReadStyle style, bool *durationEstimated = nullptr);
+        void updateProperties(Properties properties, qint64 *bytesRead = nullptr);
 
 private:
-        QMap<QString, QString> metadata;
+        void readProperties(const TagLib::FileRef &file, const TagLib::PropertyMap &tags,
+                            Properties properties);
 };
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(Song::Properties)
+Q_DECLARE_TYPEINFO(Song, Q_MOVABLE_TYPE);
+
 #endif //SONG_HPP
 
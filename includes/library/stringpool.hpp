@@ -0,0 +1,51 @@
+#ifndef STRINGPOOL_HPP
+#define STRINGPOOL_HPP
+
+#include <QByteArray>
+#include <QVector>
+#include <QString>
+#include <QHash>
+
+/**
+ * Stores strings back to back as UTF-8 in one buffer, and hands out an ID for each.
+ *
+ * Strings that repeat a lot (artists, albums, genres) should be interned, so that each
+ * distinct string is only stored once. Strings that are mostly unique (titles, paths) can
+ * be appended instead, which skips the hash lookup and the memory the hash needs.
+ *
+ * The ID 0 is always the empty string.
+ */
+class StringPool
+{
+public:
+        StringPool();
+
+        quint32 intern(const QString &string);
+        quint32 append(const QString &string);
+        quint32 copy(const StringPool &pool, quint32 id);
+
+        QString string(quint32 id) const;
+
+        int size() const
+        { return offsets.size() - 1; }
+
+        // How many bytes of UTF-8 a string has, and the whole pool has.
+        int length(quint32 id) const
+        { return static_cast<int>(offsets[static_cast<int>(id) + 1] - offsets[static_cast<int>(id)]); }
+
+        int byteCount() const
+        { return bytes.size(); }
+
+        int memoryUsage() const;
+
+private:
+        quint32 append(const QByteArray &string);
+
+        QByteArray bytes;
+
+        // Where each string starts in bytes, with one extra entry for where the last one ends.
+        QVector<quint32> offsets;
+        QHash<QByteArray, quint32> ids;
+};
+
+#endif // STRINGPOOL_HPP
@@ -0,0 +1,65 @@
+#ifndef WORKSTEALINGPOOL_HPP
+#define WORKSTEALINGPOOL_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <deque>
+
+/**
+ * A small fixed size thread pool where every worker owns a deque of tasks.
+ *
+ * Workers take tasks from the back of their own deque, and when they run out of
+ * work they steal from the front of somebody else's. Tasks are handed the index of
+ * the worker running them, so that any work they spawn (e.g. sub-directories found
+ * while scanning a directory) stays local to that worker until somebody steals it.
+ */
+class WorkStealingPool
+{
+public:
+        using Task = std::function<void(int worker)>;
+
+        explicit WorkStealingPool(int threads);
+        ~WorkStealingPool();
+
+        WorkStealingPool(const WorkStealingPool &) = delete;
+        WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+        void submit(Task task);
+        void submit(int worker, Task task);
+
+        void wait();
+        bool waitFor(int milliseconds);
+
+        int threadCount() const
+        { return static_cast<int>(workers.size()); }
+
+private:
+        struct Queue
+        {
+                std::mutex mutex;
+                std::deque<Task> tasks;
+        };
+
+        void work(int worker);
+        bool pop(int worker, Task &task);
+        bool steal(int thief, Task &task);
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+
+        std::atomic<int> queued;
+        std::atomic<int> pending;
+        std::atomic<unsigned> nextQueue;
+        bool stopping;
+
+        std::mutex stateMutex;
+        std::condition_variable workAvailable;
+        std::condition_variable allDone;
+};
+
+#endif // WORKSTEALINGPOOL_HPP
@@ -19,6 +19,11 @@ signals:
         void gotoNextSong();
         void gotoPreviousSong();
         void updateLibrary();
+        void rescanLibrary();
+        void sortByAlbum();
+        void pauseScan();
+        void resumeScan();
+        void cancelScan();
 
 public:
         MenuBar(PlayerWindow *t_parent);
@@ -32,6 +37,8 @@ private slots:
         void playPreviousSong();
         void playNextSong();
         void libraryScanDirectory();
+        void pauseOrResumeScan();
+        void scanningChanged(bool scanning);
 
 private:
         void setUpMenus();
@@ -44,8 +51,13 @@ private:
 
         QMenu *fileMenu;
         QMenu *controlsMenu;
+        QMenu *viewMenu;
 
         QAction *scanDir;
+        QAction *rescan;
+        QAction *pauseScanning;
+        QAction *cancelScanning;
+        QAction *sortAlbums;
 
         QAction *nextSong;
         QAction *previousSong;
@@ -13,6 +13,7 @@ signals:
         void playThisNext();
         void playThisNow();
         void updateLibrary();
+        void removeFromLibrary();
 
 public:
         RightClickMenu(QWidget *parent = nullptr);
@@ -26,7 +27,9 @@ private:
         Song selectedSong;
 
         QAction *playAction;
+        QAction *playNextAction;
         QAction *editMetadataAction;
+        QAction *removeAction;
 };
 
 #endif //RIGHTCLICKMENU_HPP
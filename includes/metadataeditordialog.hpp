@@ -21,7 +21,7 @@ public:
         explicit MetadataEditorDialog(QWidget *parent = 0);
         ~MetadataEditorDialog();
 
-        void setupMetadata(Song &song);
+        void setupMetadata(const Song &t_song);
 
 public slots:
         void albumTextChanged(const QString &);
@@ -47,8 +47,7 @@ private:
 
         quint16 edits;
 
-        QMap<QString, QString> metadata;
-        QString file;
+        Song song;
 
         QPushButton *saveButton;
 };
@@ -23,6 +23,7 @@ class PlayerControls;
 class CoverArtLabel;
 class LibraryModel;
 class QTableView;
+class QLineEdit;
 class MenuBar;
 
 namespace Ui
@@ -48,8 +49,11 @@ public slots:
         void timeSeek(int);
         void metaDataChanged();
         void playNow();
+        void playNext();
         void customMenuRequested(QPoint pos);
+        void headerMenuRequested(QPoint pos);
         void updatePlaylist();
+        void removeSelected();
         void play();
 
 private:
@@ -65,6 +69,7 @@ private:
 
         CoverArtLabel *coverArtLabel;
         QTableView *libraryView;
+        QLineEdit *searchBox;
 
         QImage image;
 
@@ -1,7 +1,9 @@
 #include "includes/astoria.hpp"
 
 #include <QMediaPlayer>
-#include <QMediaPlaylist>
+#include <QtGlobal>
+
+#include "includes/library/playlist.hpp"
 
 void Astoria::init()
 {
@@ -22,7 +24,7 @@ QMediaPlayer *Astoria::getAudioInstance()
         return Audio::player;
 }
 
-QMediaPlaylist *Astoria::getPlaylistInstance()
+::Playlist *Astoria::getPlaylistInstance()
 {
         return Playlist::playlist;
 }
@@ -35,3 +37,13 @@ QUrl Astoria::getCurrentSong()
 {
         return getAudioInstance()->currentMedia().canonicalUrl();
 }
+
+/**
+ * Whether to time the slow ways of doing things alongside the fast ones, and log how they
+ * compare. Turned on by setting ASTORIA_BENCHMARK in the environment.
+ */
+bool Astoria::benchmarking()
+{
+        static const bool enabled = qEnvironmentVariableIsSet("ASTORIA_BENCHMARK");
+        return enabled;
+}
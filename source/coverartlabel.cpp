@@ -15,9 +15,12 @@
 #include "id3v2extendedheader.h"
 #include "mp4tag.h"
 #include "mp4file.h"
+#include "id3v2framefactory.h"
 #pragma GCC diagnostic pop
 #pragma GCC diagnostic pop
 
+#include "includes/library/prefetchedstream.hpp"
+
 CoverArtLabel::CoverArtLabel(QWidget *parent)
         : QLabel(parent),
           coverArtImage(new QImage)
@@ -48,8 +51,12 @@ void CoverArtLabel::artChanged(TagLib::FileRef newSong)
 
         bool coverArtNotFound = true;
 
+        // Only the tags are needed, not the audio properties. The stream has to outlive the
+        // file reading from it, and the file is read rather than mapped, as the metadata
+        // editor may be saving it.
         if (codec.name() == "audio/mp4") {
-                TagLib::MP4::File mp4(newSong.file()->name());
+                const auto stream = PrefetchedStream::prefetch(QByteArray(newSong.file()->name()));
+                TagLib::MP4::File mp4(stream.get(), false);
                 if (mp4.tag() && mp4.tag()->itemListMap().contains("covr")) {
                         TagLib::MP4::CoverArtList coverArtList =
                                 mp4.tag()->itemListMap()["covr"].toCoverArtList();
@@ -63,7 +70,8 @@ void CoverArtLabel::artChanged(TagLib::FileRef newSong)
                         }
                 }
         } else if (codec.name() == "audio/mpeg") {
-                TagLib::MPEG::File file(newSong.file()->name());
+                const auto stream = PrefetchedStream::prefetch(QByteArray(newSong.file()->name()));
+                TagLib::MPEG::File file(stream.get(), TagLib::ID3v2::FrameFactory::instance(), false);
                 if (file.ID3v2Tag()) {
                         TagLib::ID3v2::FrameList frameList = file.ID3v2Tag()->frameList("APIC");
 
@@ -0,0 +1,79 @@
+#include "includes/library/fuzzypattern.hpp"
+
+#include <algorithm>
+
+constexpr int FuzzyPattern::maxLength;
+
+FuzzyPattern::FuzzyPattern(const QString &word)
+        : size(qMin(word.size(), maxLength)),
+          ascii()
+{
+        for (int i = 0; i < size; ++i) {
+                const ushort unicode = word.at(i).unicode();
+                if (unicode < 128) {
+                        ascii[unicode] |= quint64(1) << i;
+                } else {
+                        other[unicode] |= quint64(1) << i;
+                }
+        }
+}
+
+/**
+ * How many typos to allow for. Short words would match nearly anything if they were allowed
+ * any at all, and anything more than two stops looking like the same word.
+ */
+int FuzzyPattern::maxErrors() const
+{
+        if (size <= 3) {
+                return 0;
+        }
+
+        return size <= 6 ? 1 : 2;
+}
+
+/**
+ * Find how closely the word matches anywhere in some text.
+ *
+ * @param text The text to look in, normalized the same way as the word.
+ * @param textLength How many characters of text there are.
+ * @return The fewest insertions, deletions, and substitutions it takes to turn the word
+ *         into part of the text.
+ */
+int FuzzyPattern::distance(const QChar *text, int textLength) const
+{
+        if (size == 0) {
+                return 0;
+        }
+
+        // Bits set in positive/negative are where the distance goes up/down by one going
+        // down the current column of the table.
+        quint64 positive = ~quint64(0);
+        quint64 negative = 0;
+        const quint64 last = quint64(1) << (size - 1);
+
+        int score = size;
+        int best = size;
+        for (int i = 0; i < textLength && best > 0; ++i) {
+                const quint64 equal = mask(text[i]);
+                const quint64 vertical = equal | negative;
+                const quint64 horizontal = (((equal & positive) + positive) ^ positive) | equal;
+
+                quint64 horizontalPositive = negative | ~(horizontal | positive);
+                quint64 horizontalNegative = positive & horizontal;
+                if (horizontalPositive & last) {
+                        ++score;
+                } else if (horizontalNegative & last) {
+                        --score;
+                }
+
+                // Nothing is shifted in, as a match can start anywhere in the text.
+                horizontalPositive <<= 1;
+                horizontalNegative <<= 1;
+                positive = horizontalNegative | ~(vertical | horizontalPositive);
+                negative = horizontalPositive & vertical;
+
+                best = std::min(best, score);
+        }
+
+        return best;
+}
@@ -0,0 +1,313 @@
+#include "includes/library/librarycache.hpp"
+
+#include <QStandardPaths>
+#include <QSaveFile>
+#include <QtEndian>
+#include <QDebug>
+#include <QDir>
+
+#include <cstring>
+
+static constexpr char cacheMagic[4] = { 'A', 'S', 'L', 'C' };
+static constexpr quint32 cacheVersion = 5;
+
+// Magic, version, song count, and which of the optional properties the songs have.
+static constexpr qint64 headerLength = 4 + 4 + 4 + 4;
+
+namespace
+{
+        /**
+         * Reads values out of the mapped file, keeping track of whether it has run off
+         * the end of it (in which case the cache is considered to be corrupt).
+         */
+        class Reader
+        {
+        public:
+                Reader(const uchar *t_data, qint64 t_length, qint64 offset)
+                        : position(t_data + offset), end(t_data + t_length), ok(offset <= t_length)
+                { }
+
+                template <typename T>
+                T read()
+                {
+                        if (end - position < static_cast<qint64>(sizeof(T))) {
+                                ok = false;
+                                return T();
+                        }
+
+                        const T value = qFromLittleEndian<T>(position);
+                        position += sizeof(T);
+                        return value;
+                }
+
+                QString readString()
+                {
+                        const quint32 stringLength = read<quint32>();
+                        if (!ok || end - position < static_cast<qint64>(stringLength)) {
+                                ok = false;
+                                return QString();
+                        }
+
+                        const QString string = QString::fromUtf8(reinterpret_cast<const char *>(position),
+                                                                 static_cast<int>(stringLength));
+                        position += stringLength;
+                        return string;
+                }
+
+                const uchar *position;
+                const uchar *end;
+                bool ok;
+        };
+
+        template <typename T>
+        void write(QByteArray &buffer, T value)
+        {
+                uchar bytes[sizeof(T)];
+                qToLittleEndian<T>(value, bytes);
+                buffer.append(reinterpret_cast<const char *>(bytes), static_cast<int>(sizeof(T)));
+        }
+
+        void writeString(QByteArray &buffer, const QString &string)
+        {
+                const QByteArray utf8 = string.toUtf8();
+                write<quint32>(buffer, static_cast<quint32>(utf8.length()));
+                buffer.append(utf8);
+        }
+}
+
+LibraryCache::LibraryCache(const QString &fileName)
+        : file(fileName),
+          data(nullptr),
+          length(0),
+          storedProperties()
+{
+
+}
+
+LibraryCache::~LibraryCache()
+{
+        if (data != nullptr) {
+                file.unmap(const_cast<uchar *>(data));
+        }
+}
+
+QString LibraryCache::defaultLocation()
+{
+        return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/library.cache";
+}
+
+/**
+ * Write the songs out to a cache file. The file is written to the side and then moved in
+ * to place, so anything that still has the old cache mapped isn't affected.
+ *
+ * @param fileName Where to write the cache to.
+ * @param songs The songs to store.
+ * @return Whether the cache was written.
+ */
+bool LibraryCache::save(const QString &fileName, const LibraryStore &songs)
+{
+        QDir().mkpath(QFileInfo(fileName).absolutePath());
+
+        QSaveFile cacheFile(fileName);
+        if (!cacheFile.open(QIODevice::WriteOnly)) {
+                return false;
+        }
+
+        QByteArray buffer;
+        buffer.append(cacheMagic, sizeof(cacheMagic));
+        write<quint32>(buffer, cacheVersion);
+        write<quint32>(buffer, static_cast<quint32>(songs.count()));
+        write<quint32>(buffer, static_cast<quint32>(songs.properties()));
+
+        QByteArray record;
+        for (int i = 0; i < songs.size(); ++i) {
+                if (songs.isRemoved(i)) {
+                        continue;
+                }
+                const Song song = songs.song(i);
+
+                record.clear();
+                write<qint64>(record, song.size);
+                write<qint64>(record, song.modified);
+                write<quint64>(record, song.device);
+                write<quint64>(record, song.inode);
+                writeString(record, song.filePath);
+                writeString(record, song.canonicalPath);
+                write<qint32>(record, song.duration);
+                write<qint32>(record, song.year);
+                write<qint32>(record, song.track);
+                write<qint32>(record, song.disc);
+                writeString(record, song.title);
+                writeString(record, song.artist);
+                writeString(record, song.album);
+                writeString(record, song.genre);
+
+                // Only the properties that are stored for every song are written.
+                if (songs.properties() & Song::Composer) {
+                        writeString(record, song.composer);
+                }
+                if (songs.properties() & Song::Comment) {
+                        writeString(record, song.comment);
+                }
+                if (songs.properties() & Song::Bpm) {
+                        write<qint32>(record, song.bpm);
+                }
+                if (songs.properties() & Song::Bitrate) {
+                        write<qint32>(record, song.bitrate);
+                }
+                if (songs.properties() & Song::SampleRate) {
+                        write<qint32>(record, song.sampleRate);
+                }
+
+                write<quint32>(buffer, static_cast<quint32>(record.length()));
+                buffer.append(record);
+
+                if (buffer.length() > (1 << 20)) {
+                        cacheFile.write(buffer);
+                        buffer.clear();
+                }
+        }
+
+        cacheFile.write(buffer);
+        return cacheFile.commit();
+}
+
+/**
+ * Map the cache file, and find where each song's record starts.
+ *
+ * @return Whether the file could be mapped, and is a cache we understand.
+ */
+bool LibraryCache::open()
+{
+        if (!file.open(QIODevice::ReadOnly) || file.size() < headerLength) {
+                return false;
+        }
+
+        // The file is left open, as the mapping is only guaranteed to be around for as
+        // long as it is.
+        length = file.size();
+        data = file.map(0, length);
+
+        if (data == nullptr || memcmp(data, cacheMagic, sizeof(cacheMagic)) != 0 ||
+            qFromLittleEndian<quint32>(data + 4) != cacheVersion) {
+                return false;
+        }
+
+        const quint32 songCount = qFromLittleEndian<quint32>(data + 8);
+        storedProperties = Song::Properties(static_cast<int>(qFromLittleEndian<quint32>(data + 12)));
+        records.reserve(static_cast<int>(songCount));
+        offsets.reserve(static_cast<int>(songCount));
+
+        Reader reader(data, length, headerLength);
+        for (quint32 i = 0; i < songCount; ++i) {
+                const quint32 recordLength = reader.read<quint32>();
+                const qint64 offset = reader.position - data;
+
+                // The record has to fit in the file before anything is read out of it, as
+                // its end comes from the file too.
+                bool valid = reader.ok && offset + 32 <= length && offset + recordLength <= length;
+
+                QString path;
+                if (valid) {
+                        // Skip the size, modification time, device, and inode to get to the path.
+                        Reader record(data, offset + recordLength, offset + 32);
+                        path = record.readString();
+                        valid = record.ok;
+                }
+
+                if (!valid) {
+                        qWarning() << "The library cache" << file.fileName() << "is corrupt, ignoring it";
+                        records.clear();
+                        offsets.clear();
+                        return false;
+                }
+
+                records.insert(path, offset);
+                offsets.append(offset);
+                reader.position += recordLength;
+        }
+
+        return true;
+}
+
+/**
+ * @return Every song in the cache.
+ */
+QList<Song> LibraryCache::songs() const
+{
+        QList<Song> cachedSongs;
+        cachedSongs.reserve(offsets.size());
+
+        for (auto offset : offsets) {
+                cachedSongs.append(read(offset));
+        }
+
+        return cachedSongs;
+}
+
+/**
+ * Check whether the cache has a song for the given file, and that the file hasn't changed
+ * since that song was read.
+ *
+ * @param path The path of the file.
+ * @param size The file's current size.
+ * @param modified The file's current modification time.
+ */
+bool LibraryCache::isUpToDate(const QString &path, qint64 size, qint64 modified) const
+{
+        const auto record = records.constFind(path);
+        if (record == records.constEnd()) {
+                return false;
+        }
+
+        Reader reader(data, length, record.value());
+        return reader.read<qint64>() == size && reader.read<qint64>() == modified;
+}
+
+/**
+ * @param path The path of a file that's in the cache.
+ * @return The cached song for that file.
+ */
+Song LibraryCache::song(const QString &path) const
+{
+        return read(records.value(path));
+}
+
+Song LibraryCache::read(qint64 offset) const
+{
+        Reader reader(data, length, offset);
+
+        Song song;
+        song.size = reader.read<qint64>();
+        song.modified = reader.read<qint64>();
+        song.device = reader.read<quint64>();
+        song.inode = reader.read<quint64>();
+        song.filePath = reader.readString();
+        song.canonicalPath = reader.readString();
+        song.duration = reader.read<qint32>();
+        song.year = reader.read<qint32>();
+        song.track = reader.read<qint32>();
+        song.disc = reader.read<qint32>();
+        song.title = reader.readString();
+        song.artist = reader.readString();
+        song.album = reader.readString();
+        song.genre = reader.readString();
+
+        if (storedProperties & Song::Composer) {
+                song.composer = reader.readString();
+        }
+        if (storedProperties & Song::Comment) {
+                song.comment = reader.readString();
+        }
+        if (storedProperties & Song::Bpm) {
+                song.bpm = reader.read<qint32>();
+        }
+        if (storedProperties & Song::Bitrate) {
+                song.bitrate = reader.read<qint32>();
+        }
+        if (storedProperties & Song::SampleRate) {
+                song.sampleRate = reader.read<qint32>();
+        }
+
+        return song;
+}
@@ -0,0 +1,47 @@
+#include "includes/library/librarycolumns.hpp"
+
+namespace LibraryColumns
+{
+        template <QString (LibraryStore::*field)(int) const>
+        QVariant text(const LibraryStore &library, int record)
+        { return (library.*field)(record); }
+
+        template <int (LibraryStore::*field)(int) const>
+        QVariant number(const LibraryStore &library, int record)
+        { return (library.*field)(record); }
+
+        template <int (LibraryStore::*field)(int) const, QString (*format)(int)>
+        QVariant formatted(const LibraryStore &library, int record)
+        { return format((library.*field)(record)); }
+
+        const LibraryColumn all[] = {
+                {"Title", true, Song::Property(), LibraryStore::Title,
+                 &text<&LibraryStore::title>, &text<&LibraryStore::title>},
+                {"Artist", true, Song::Property(), LibraryStore::Artist,
+                 &text<&LibraryStore::artist>, &text<&LibraryStore::artist>},
+                {"Album", true, Song::Property(), LibraryStore::Album,
+                 &text<&LibraryStore::album>, &text<&LibraryStore::album>},
+                {"Track", true, Song::Property(), LibraryStore::Track,
+                 &number<&LibraryStore::track>, &formatted<&LibraryStore::track, &Song::formatNumber>},
+                {"Year", true, Song::Property(), LibraryStore::Year,
+                 &number<&LibraryStore::year>, &formatted<&LibraryStore::year, &Song::formatNumber>},
+                {"Genre", true, Song::Property(), LibraryStore::Genre,
+                 &text<&LibraryStore::genre>, &text<&LibraryStore::genre>},
+                {"Duration", true, Song::Property(), LibraryStore::Duration,
+                 &number<&LibraryStore::duration>, &formatted<&LibraryStore::duration, &Song::formatDuration>},
+                {"Disc", false, Song::Property(), LibraryStore::Disc,
+                 &number<&LibraryStore::disc>, &formatted<&LibraryStore::disc, &Song::formatNumber>},
+                {"Composer", false, Song::Composer, LibraryStore::Composer,
+                 &text<&LibraryStore::composer>, &text<&LibraryStore::composer>},
+                {"BPM", false, Song::Bpm, LibraryStore::Bpm,
+                 &number<&LibraryStore::bpm>, &formatted<&LibraryStore::bpm, &Song::formatNumber>},
+                {"Bitrate", false, Song::Bitrate, LibraryStore::Bitrate,
+                 &number<&LibraryStore::bitrate>, &formatted<&LibraryStore::bitrate, &Song::formatBitrate>},
+                {"Sample Rate", false, Song::SampleRate, LibraryStore::SampleRate,
+                 &number<&LibraryStore::sampleRate>, &formatted<&LibraryStore::sampleRate, &Song::formatSampleRate>},
+                {"Comment", false, Song::Comment, LibraryStore::Comment,
+                 &text<&LibraryStore::comment>, &text<&LibraryStore::comment>},
+        };
+
+        const int count = sizeof(all) / sizeof(all[0]);
+}
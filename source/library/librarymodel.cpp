@@ -1,21 +1,48 @@
 #include "includes/library/librarymodel.hpp"
 
+#include <QElapsedTimer>
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QFile>
+#include <QSettings>
+#include <QDebug>
 #include <QMediaPlayer>
+#include <QHash>
 
+#include <algorithm>
+
+#include "includes/library/propertyloader.hpp"
+#include "includes/library/librarycache.hpp"
 #include "includes/library/musicscanner.hpp"
 #include "includes/astoria.hpp"
 
+// How many rows are shown at a time, which only has to be enough to fill the view.
+static constexpr int rowsPerFetch = 1000;
+
+// How long after the library last changed it's saved, in milliseconds.
+static constexpr int saveDelay = 10000;
+
 LibraryModel::LibraryModel()
-        : rows(0)
-{
-        columnHeaders = {
-                "Title",
-                "Artist",
-                "Album",
-                "Genre",
-                "Duration",
-        };
+        : sorter(library),
+          search(library)
+{
+        // The columns the user chose to show last time, in the order they were shown in.
+        const QStringList shown = QSettings().value("library/columns").toStringList();
+        for (const QString &header : shown) {
+                for (int column = 0; column < LibraryColumns::count; ++column) {
+                        if (header == LibraryColumns::all[column].header && !columns.contains(column)) {
+                                columns.append(column);
+                        }
+                }
+        }
+        if (columns.isEmpty()) {
+                for (int column = 0; column < LibraryColumns::count; ++column) {
+                        if (LibraryColumns::all[column].shownByDefault) {
+                                columns.append(column);
+                        }
+                }
+        }
+        library.setProperties(shownProperties());
 
         supportedFormats = {
                 "*.mp3",
@@ -40,11 +67,42 @@ LibraryModel::LibraryModel()
         };
 
         sort = AToZ;
+        ranked = false;
+        fetched = 0;
+
+        // Restore the library as it was when it was last saved.
+        QElapsedTimer timer;
+        timer.start();
+
+        cache = QSharedPointer<LibraryCache>::create();
+        if (cache->open()) {
+                updateLibrary(cache->songs());
+                qDebug() << "Restored" << library.size() << "songs from the library cache in" << timer.elapsed() << "ms";
+
+                // Columns might have been shown since the cache was saved.
+                loadProperties(library.properties() & ~cache->properties());
+        }
+
+        saveTimer.setSingleShot(true);
+        saveTimer.setInterval(saveDelay);
+        connect(&saveTimer, &QTimer::timeout, this, &LibraryModel::saveCache);
+
+        // Keep up with the directories the library was scanned from while we're running.
+        watcher = new LibraryWatcher(supportedFormats, this);
+        watcher->setProperties(library.properties());
+        connect(watcher, SIGNAL(libraryChanged(LibraryDelta)), this, SLOT(applyDelta(LibraryDelta)));
+        for (const QString &root : QSettings().value("library/roots").toStringList()) {
+                watcher->watch(root);
+        }
+        watcher->start(QThread::LowPriority);
 }
 
 LibraryModel::~LibraryModel()
 {
-
+        // Changes that haven't been saved yet would otherwise be scanned for again.
+        if (saveTimer.isActive()) {
+                saveCache();
+        }
 }
 
 bool LibraryModel::setData(const QModelIndex &index, const QVariant &value, int role)
@@ -55,32 +113,192 @@ bool LibraryModel::setData(const QModelIndex &index, const QVariant &value, int
 int LibraryModel::columnCount(const QModelIndex &parent) const
 {
         (void) parent;
-        return columnHeaders.length();
+        return columns.size();
 }
 
 int LibraryModel::rowCount(const QModelIndex &parent) const
 {
         (void) parent;
-        return rows;
+        return fetched;
 }
 
-QVariant LibraryModel::headerData(int section, Qt::Orientation orientation, int role) const
+bool LibraryModel::canFetchMore(const QModelIndex &parent) const
 {
-        if (role == Qt::DisplayRole) {
-                if (orientation == Qt::Horizontal) {
-                        // TODO: Change this slightly so that columns can be added/removed.
-                        switch (section) {
-                        case 0:
-                        case 1:
-                        case 2:
-                        case 3:
-                        case 4:
-                                return getColumnHeader(section);
-                        default:
-                                return QVariant();
-                        }
+        return !parent.isValid() && fetched < rows().size();
+}
+
+/**
+ * Show another page of rows, which the view asks for when it's scrolled to the last row
+ * shown so far.
+ */
+void LibraryModel::fetchMore(const QModelIndex &parent)
+{
+        if (!parent.isValid()) {
+                fetchTo(fetched + rowsPerFetch);
+        }
+}
+
+/**
+ * Show at least the first count rows, or every row if there aren't that many.
+ */
+void LibraryModel::fetchTo(int count)
+{
+        count = qMin(count, rows().size());
+        if (count <= fetched) {
+                return;
+        }
+
+        beginInsertRows(QModelIndex(), fetched, count - 1);
+        fetched = count;
+        endInsertRows();
+}
+
+/**
+ * @param column A column, as an index into LibraryColumns::all.
+ * @return Whether the column is being shown.
+ */
+bool LibraryModel::isColumnShown(int column) const
+{
+        return columns.contains(column);
+}
+
+/**
+ * Show or hide a column. Newly shown columns go at the end. If the column needs metadata
+ * that isn't being read yet, it's read in the background, and the column fills in as it
+ * is. If nothing else needs the metadata a hidden column showed, it's thrown away.
+ *
+ * @param column A column, as an index into LibraryColumns::all.
+ * @param shown Whether to show it.
+ */
+void LibraryModel::setColumnShown(int column, bool shown)
+{
+        if (column < 0 || column >= LibraryColumns::count || shown == isColumnShown(column)) {
+                return;
+        }
+
+        if (shown) {
+                beginInsertColumns(QModelIndex(), columns.size(), columns.size());
+                columns.append(column);
+                endInsertColumns();
+        } else if (columns.size() > 1) {
+                const int section = columns.indexOf(column);
+                beginRemoveColumns(QModelIndex(), section, section);
+                columns.remove(section);
+                endRemoveColumns();
+        }
+
+        const Song::Properties wanted = shownProperties();
+        const Song::Properties added = wanted & ~library.properties();
+        library.setProperties(wanted);
+        watcher->setProperties(wanted);
+        sorter.invalidate();
+        loadProperties(added);
+
+        QStringList headers;
+        for (int shownColumn : columns) {
+                headers.append(LibraryColumns::all[shownColumn].header);
+        }
+        QSettings().setValue("library/columns", headers);
+}
+
+/**
+ * @return The metadata that the columns being shown need, on top of the basic tags.
+ */
+Song::Properties LibraryModel::shownProperties() const
+{
+        Song::Properties properties;
+        for (int column : columns) {
+                properties |= LibraryColumns::all[column].property;
+        }
+
+        return properties;
+}
+
+/**
+ * Read some properties for every song in the library, in the background.
+ */
+void LibraryModel::loadProperties(Song::Properties properties)
+{
+        QVector<int> records;
+        records.reserve(library.size());
+        for (int record = 0; record < library.size(); ++record) {
+                if (!library.isRemoved(record)) {
+                        records.append(record);
+                }
+        }
+
+        loadProperties(properties, records);
+}
+
+/**
+ * Read some properties for some of the songs in the library, in the background.
+ */
+void LibraryModel::loadProperties(Song::Properties properties, const QVector<int> &records)
+{
+        if (!properties || records.isEmpty()) {
+                return;
+        }
+
+        QStringList paths;
+        paths.reserve(records.size());
+        for (int record : records) {
+                paths.append(library.path(record));
+        }
+
+        PropertyLoader *loader = new PropertyLoader(records, paths, properties);
+        connect(loader, SIGNAL(propertiesLoaded(QVector<int>, QList<Song>, int)),
+                this, SLOT(updateProperties(QVector<int>, QList<Song>, int)));
+        connect(loader, SIGNAL(finished()), loader, SLOT(deleteLater()));
+        loader->start(QThread::LowPriority);
+}
+
+/**
+ * Read the durations of songs that the scanner only estimated, properly this time.
+ *
+ * @param paths The files whose durations were estimated.
+ */
+void LibraryModel::refineDurations(QStringList paths)
+{
+        QVector<int> estimated;
+        estimated.reserve(paths.size());
+        for (const QString &path : paths) {
+                const int record = recordOf(path);
+                if (record >= 0) {
+                        estimated.append(record);
+                }
+        }
+
+        loadProperties(Song::Duration, estimated);
+}
+
+/**
+ * Fill in properties read in the background. Anything that's stopped being shown since is
+ * ignored.
+ */
+void LibraryModel::updateProperties(QVector<int> records, QList<Song> songs, int properties)
+{
+        for (int i = 0; i < records.size(); ++i) {
+                // Songs can be removed while their properties are being read, which moves
+                // the records after them.
+                if (records[i] < library.size() && !library.isRemoved(records[i]) &&
+                    library.path(records[i]) == songs[i].filePath) {
+                        library.updateProperties(records[i], songs[i], Song::Properties(properties));
                 }
         }
+        sorter.invalidate();
+
+        if (fetched > 0) {
+                emit dataChanged(index(0, 0), index(fetched - 1, columnCount() - 1));
+        }
+}
+
+QVariant LibraryModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+        if (role == Qt::DisplayRole && orientation == Qt::Horizontal
+            && section >= 0 && section < columns.size()) {
+                return QString(columnAt(section).header);
+        }
+
         return QVariant();
 }
 
@@ -89,28 +307,20 @@ Qt::ItemFlags LibraryModel::flags(const QModelIndex &index) const
         return QAbstractTableModel::flags(index);
 }
 
+/**
+ * The display role gets each field formatted for the user to read, while the edit and user
+ * roles get the field as it's stored (e.g. the duration in milliseconds, rather than as
+ * minutes and seconds).
+ */
 QVariant LibraryModel::data(const QModelIndex &index, int role) const
 {
         if (index.isValid()) {
-                if (role == Qt::DisplayRole) {
-                        if (library.length() == 0) {
-                                return QVariant();
-                        }
+                const int record = rows()[index.row()];
 
-                        const QMap<QString, QString> &metadata = songAt(index.row()).getMetadata();
-                        const QString columnHeader = getColumnHeader(index.column());
-
-                        // TODO: Change this slightly so that columns can be added/removed.
-                        switch (index.column()) {
-                        case 0:
-                        case 1:
-                        case 2:
-                        case 3:
-                        case 4:
-                                return metadata[columnHeader];
-                        default:
-                                return QVariant();
-                        }
+                if (role == Qt::DisplayRole) {
+                        return columnAt(index.column()).display(library, record);
+                } else if (role == Qt::EditRole || role == Qt::UserRole) {
+                        return columnAt(index.column()).value(library, record);
                 }
         }
 
@@ -124,28 +334,258 @@ void LibraryModel::openDirectory()
 }
 
 /**
- * Scan a given directory to find all song files.
- * At the moment it only does a search of the files in that directory, not any sub-directories.
+ * Scan a given directory, and all of its sub-directories, to find all song files.
+ *
+ * The number of threads used by the scanner can be changed with the "scanner/threads"
+ * setting, and defaults to the number of cores available. Songs are added to the library
+ * as they're found, in batches of at most "scanner/batchSize" songs, or whatever was
+ * found in "scanner/batchInterval" milliseconds. Files that haven't changed since the library
+ * was last saved are taken from the library cache rather than being read again.
+ *
+ * Unless "scanner/fast" is turned off, only the headers of each file are read for its
+ * duration, which is read properly in the background once the scan is done.
+ *
+ * "scanner/order" picks the order files are read in: "directory" (as they're found),
+ * "inode", or "physical" (where they are on the disk). By default ("auto") spinning disks
+ * are read in physical order, and everything else in directory order.
+ *
+ * While a song is playing, the scan keeps to the background (see playbackStateChanged()).
+ * The directory is watched from then on, so that the library keeps up with it.
  *
  * @param directory The directory to look for song files in.
  */
 void LibraryModel::scanDirectory(QString &directory)
 {
-        // TODO: Should sub-directories be searched through?
-        // TODO:  - Might cause a lengthy process.
-        QDir musicDirectory(directory);
-        QFileInfoList musicFiles = musicDirectory.entryInfoList(supportedFormats);
-        MusicScanner *scanner = new MusicScanner(musicFiles);
+        if (directory.isEmpty()) {
+                return;
+        }
+
+        // Only one scan runs at a time, so that it can be paused or cancelled, and this one
+        // waits for the one that's running (see scanStopped()).
+        if (scanner) {
+                if (!scanQueue.contains(directory)) {
+                        scanQueue.append(directory);
+                }
+                return;
+        }
+
+        startScan(directory);
+}
+
+/**
+ * Start scanning a directory (see scanDirectory()).
+ */
+void LibraryModel::startScan(const QString &directory)
+{
+        watchDirectory(directory);
+
+        if (!cache) {
+                cache = QSharedPointer<LibraryCache>::create();
+                cache->open();
+        }
+
+        QSettings settings;
+        scanner = createScanner(directory);
+        scanner->setBatching(settings.value("scanner/batchSize", 1000).toInt(),
+                             settings.value("scanner/batchInterval", 250).toInt());
+        scanner->setCache(cache);
         connect(scanner, SIGNAL(passNewItems(QList<Song>)), this, SLOT(updateLibrary(QList<Song>)));
-        connect(scanner, SIGNAL(finished()), scanner, SLOT(deleteLater()));
+        connect(scanner, SIGNAL(scanFinished(int, qint64)), this, SLOT(saveCache()));
+
+        startScanner();
+}
+
+/**
+ * Check every directory the library was scanned from for songs that have been added,
+ * changed, or removed since, and bring the library up to date with them. Only new and
+ * changed files are read, and the library's rows are only touched where songs changed
+ * (see applyDelta()), so rescanning a library that hasn't changed leaves it as it is.
+ *
+ * The directories are rescanned one at a time, after any scan that's already running.
+ */
+void LibraryModel::rescanLibrary()
+{
+        for (const QString &root : QSettings().value("library/roots").toStringList()) {
+                if (!rescanQueue.contains(root)) {
+                        rescanQueue.append(root);
+                }
+        }
+
+        if (!scanner) {
+                rescanNext();
+        }
+}
+
+/**
+ * Start rescanning the next directory waiting to be rescanned.
+ *
+ * @return Whether a rescan was started.
+ */
+bool LibraryModel::rescanNext()
+{
+        while (!rescanQueue.isEmpty()) {
+                if (rescanDirectory(rescanQueue.takeFirst())) {
+                        return true;
+                }
+        }
+
+        return false;
+}
+
+/**
+ * Rescan a directory, comparing what's in it against the songs in the library from it.
+ *
+ * @return Whether the rescan was started, which it isn't if the directory's gone.
+ */
+bool LibraryModel::rescanDirectory(const QString &directory)
+{
+        const QString root = QFileInfo(directory).canonicalFilePath();
+        if (root.isEmpty()) {
+                return false;
+        }
+
+        // Everything in the library that's under the directory, as it was when it was read.
+        const QString prefix = root + '/';
+        QHash<QByteArray, MusicScanner::KnownFile> known;
+        for (auto file = libraryPaths.constBegin(); file != libraryPaths.constEnd(); ++file) {
+                if (file.key().startsWith(prefix)) {
+                        known.insert(QFile::encodeName(file.key()),
+                                     {library.fileSize(file.value()), library.modifiedTime(file.value())});
+                }
+        }
+
+        scanner = createScanner(root);
+        scanner->setKnownFiles(known);
+        connect(scanner, SIGNAL(deltaFound(LibraryDelta)), this, SLOT(applyDelta(LibraryDelta)));
+
+        startScanner();
+        return true;
+}
+
+/**
+ * Set up a scanner with everything a scan and a rescan have in common, which is mostly the
+ * user's settings (see scanDirectory()).
+ */
+MusicScanner *LibraryModel::createScanner(const QString &directory)
+{
+        QSettings settings;
+        const int threads = settings.value("scanner/threads", QThread::idealThreadCount()).toInt();
+
+        MusicScanner *created = new MusicScanner(directory, supportedFormats, threads);
+        created->setProperties(library.properties());
+        const QString order = settings.value("scanner/order", "auto").toString();
+        if (order == "physical" || (order == "auto" && MusicScanner::isRotational(directory))) {
+                created->setOrder(MusicScanner::PhysicalOrder);
+        } else if (order == "inode") {
+                created->setOrder(MusicScanner::InodeOrder);
+        }
+        if (settings.value("scanner/fast", true).toBool()) {
+                created->setReadStyle(TagLib::AudioProperties::Fast);
+                connect(created, SIGNAL(durationsEstimated(QStringList)),
+                        this, SLOT(refineDurations(QStringList)));
+        }
+        connect(created, SIGNAL(finished()), this, SLOT(scanStopped()));
+        connect(created, SIGNAL(finished()), created, SLOT(deleteLater()));
+
+        return created;
+}
+
+void LibraryModel::startScanner()
+{
+        scanner->setBackground(Astoria::getAudioInstance()->state() == QMediaPlayer::PlayingState);
         scanner->start();
+        emit scanningChanged(true);
+}
+
+/**
+ * Watch a directory for changes, now and whenever the program's started again (see
+ * LibraryWatcher), unless it's already being watched.
+ */
+void LibraryModel::watchDirectory(const QString &directory)
+{
+        const QString root = QFileInfo(directory).canonicalFilePath();
+        if (root.isEmpty()) {
+                return;
+        }
+
+        QSettings settings;
+        QStringList roots = settings.value("library/roots").toStringList();
+        for (const QString &watched : roots) {
+                if (root == watched || root.startsWith(watched + '/')) {
+                        return;
+                }
+        }
+
+        roots.append(root);
+        settings.setValue("library/roots", roots);
+        watcher->watch(root);
+}
+
+/**
+ * Pause the scan that's running, if there is one.
+ */
+void LibraryModel::pauseScan()
+{
+        if (scanner) {
+                scanner->pause();
+        }
+}
+
+void LibraryModel::resumeScan()
+{
+        if (scanner) {
+                scanner->resume();
+        }
+}
+
+/**
+ * Stop the scan that's running, keeping the songs it's found so far, and drop any waiting.
+ */
+void LibraryModel::cancelScan()
+{
+        scanQueue.clear();
+        rescanQueue.clear();
+        if (scanner) {
+                scanner->cancel();
+        }
+}
+
+/**
+ * Scans keep out of the way of playback, so that songs don't stutter while a large library
+ * is being scanned.
+ */
+void LibraryModel::playbackStateChanged(QMediaPlayer::State state)
+{
+        if (scanner) {
+                scanner->setBackground(state == QMediaPlayer::PlayingState);
+        }
+}
+
+void LibraryModel::scanStopped()
+{
+        if (sender() != scanner.data()) {
+                return;
+        }
+
+        if (!scanQueue.isEmpty()) {
+                startScan(scanQueue.takeFirst());
+                return;
+        }
+        if (!rescanNext()) {
+                emit scanningChanged(false);
+        }
 }
 
 /**
- * After searching a directory, the scanner will pass the song files found to this method.
- * We want to update the library to reflect any new items added, so long as they aren't
- * duplicates, and update the view, so that any changes are available to the user as soon
- * as possible.
+ * While searching a directory, the scanner will pass batches of the song files found to
+ * this method. We want to update the library to reflect any new items added, so long as
+ * they aren't duplicates, and update the view, so that any changes are available to the
+ * user as soon as possible.
+ *
+ * The new songs are always added to the end of the store. If the library has been sorted
+ * they're then put in their sorted place, otherwise they're shown at the end. If the library
+ * is being filtered, only the ones matching the filter are shown. Songs that go after the
+ * rows shown so far aren't shown until the view fetches them.
  *
  * @param newSongs The song files found in the directory.
  */
@@ -156,86 +596,862 @@ void LibraryModel::updateLibrary(QList<Song> newSongs)
                 return;
         }
 
-        bool altered = false;
+        QList<Song> songsToAdd;
 
         for (auto &song : newSongs) {
-                bool notInLibrary = true;
-                for (auto &songInLibrary : library) {
-                        if (song.filePath == songInLibrary.filePath) {
-                                notInLibrary = false;
-                                break;
-                        }
+                if (!isInLibrary(song)) {
+                        // Indexing the song straight away also catches a batch that contains
+                        // the same file twice.
+                        addToIndex(song, library.size() + songsToAdd.length());
+                        songsToAdd.append(song);
                 }
+        }
+
+        if (songsToAdd.isEmpty()) {
+                return;
+        }
+
+        QVector<int> records;
+        records.reserve(songsToAdd.length());
+        for (auto &song : songsToAdd) {
+                records.append(library.append(song));
+                search.add(records.last());
+        }
 
-                if (notInLibrary) {
-                        beginInsertRows(QModelIndex(), rowCount(), rowCount());
-                        library.append(song);
-                        endInsertRows();
-                        ++rows;
-                        Astoria::getPlaylistInstance()->addMedia(QUrl::fromLocalFile(song.filePath));
-                        altered = true;
+        insertRecords(order, records, filter.isEmpty());
+        if (!filter.isEmpty()) {
+                // Only the new songs have to be checked against the filter, rather than
+                // searching the whole library again for every batch.
+                matches.resize(library.size());
+                if (ranked) {
+                        distances.resize(library.size());
+                        search.fuzzyFind(filter, records, distances);
+                        for (int record : records) {
+                                matches.setBit(record, distances[record] != SearchIndex::noMatch);
+                        }
+
+                        // The closest songs are already at the top, so these go at the end.
+                        filtered += matching(records);
+                } else {
+                        search.find(filter, records, matches);
+                        insertRecords(filtered, matching(records), true);
                 }
         }
 
-        if (altered) {
-                emit libraryUpdated();
+        // The view only asks for more rows when it's scrolled, so the first page has to be
+        // filled in as songs are found.
+        fetchTo(rowsPerFetch);
+
+        QStringList paths;
+        paths.reserve(songsToAdd.length());
+        for (auto &song : songsToAdd) {
+                paths.append(song.filePath);
         }
-}
+        Astoria::Playlist::addFiles(paths);
 
-const QUrl LibraryModel::get(int row) const
-{
-        return QUrl::fromLocalFile(library.at(row).filePath);
+        emit libraryUpdated();
 }
 
-const QString &LibraryModel::getColumnHeader(int column) const
+/**
+ * Bring the library up to date with changes to the directories it was scanned from (see
+ * LibraryWatcher). Only the rows for songs that were removed, changed, or added are touched,
+ * rather than the whole library being reset.
+ *
+ * @param delta What changed.
+ */
+void LibraryModel::applyDelta(LibraryDelta delta)
 {
-        return columnHeaders.at(column);
+        QElapsedTimer timer;
+        timer.start();
+
+        QVector<int> removed;
+        for (const QString &path : delta.removed) {
+                const int record = recordOf(path);
+                if (record >= 0) {
+                        removed.append(record);
+                }
+        }
+        for (const QString &directory : delta.removedDirectories) {
+                const QString prefix = directory + '/';
+                for (auto file = libraryPaths.constBegin(); file != libraryPaths.constEnd(); ++file) {
+                        if (file.key().startsWith(prefix)) {
+                                removed.append(file.value());
+                        }
+                }
+        }
+        std::sort(removed.begin(), removed.end());
+        removed.erase(std::unique(removed.begin(), removed.end()), removed.end());
+        removeFromLibrary(removed);
+
+        QVector<int> changed;
+        QList<Song> changedSongs;
+        QList<Song> added;
+        for (const Song &song : delta.songs) {
+                const int record = recordOf(song.canonicalPath.isEmpty() ? song.filePath : song.canonicalPath);
+                if (record >= 0) {
+                        changed.append(record);
+                        changedSongs.append(song);
+                } else {
+                        added.append(song);
+                }
+        }
+        replaceRecords(changed, changedSongs);
+        // The changed songs' old paths and titles are left behind in the store.
+        if (library.needsCompacting()) {
+                compact();
+        }
+        updateLibrary(added);
+
+        if (Astoria::benchmarking()) {
+                qDebug() << "Removed" << removed.size() << "songs, updated" << changed.size() << "and added"
+                         << added.size() << "in" << timer.elapsed() << "ms";
+        }
+
+        // The watcher lost track of these, so they have to be rescanned to catch up.
+        for (const QString &root : delta.rescan) {
+                if (!rescanQueue.contains(root)) {
+                        rescanQueue.append(root);
+                }
+        }
+        if (!scanner) {
+                rescanNext();
+        }
+
+        if (!removed.isEmpty() || !changed.isEmpty()) {
+                emit libraryUpdated();
+        }
+        if (!removed.isEmpty() || !changed.isEmpty() || !added.isEmpty()) {
+                saveTimer.start();
+        }
 }
 
 /**
- * Sort a given column.
+ * Remove some rows from the library (see removeFromLibrary()).
  *
- * @param column The column to sort.
+ * @param row The first row to remove.
+ * @param count How many rows to remove.
+ * @param parent Unused, as the library's a flat table.
+ * @return Whether the rows were removed, which they aren't if they aren't all shown.
  */
-void LibraryModel::sortByColumn(int column)
+bool LibraryModel::removeRows(int row, int count, const QModelIndex &parent)
 {
-        switch (sort) {
-        case AToZ:
-                std::sort(library.begin(), library.end(),
-                          [column, this](const Song &a, const Song &b) -> bool {
-                                  return a.getMetadata()[getColumnHeader(column)] <
-                                          b.getMetadata()[getColumnHeader(column)];
-                          }
-                );
-                sort = ZToA;
-                break;
-        case ZToA:
-                std::sort(library.begin(), library.end(),
-                          [column, this](const Song &a, const Song &b) -> bool {
-                                  return a.getMetadata()[getColumnHeader(column)] >
-                                          b.getMetadata()[getColumnHeader(column)];
-                          }
-                );
-                sort = AToZ;
-                break;
-        }
-
-        emit dataChanged(QModelIndex(), QModelIndex());
+        if (parent.isValid() || row < 0 || count <= 0 || row + count > fetched) {
+                return false;
+        }
+
+        removeFromLibrary(rows().mid(row, count));
+        return true;
 }
 
-/*
+/**
+ * Remove the songs in some rows from the library, e.g. the ones the user has selected.
+ *
+ * @param indexes Any indexes in the rows to remove, of which there can be several per row.
+ */
+void LibraryModel::removeSongs(const QModelIndexList &indexes)
+{
+        QVector<int> records;
+        records.reserve(indexes.size());
+        for (const QModelIndex &selected : indexes) {
+                if (selected.isValid() && selected.row() < fetched) {
+                        records.append(rows()[selected.row()]);
+                }
+        }
+
+        removeFromLibrary(records);
+}
+
+/**
+ * Remove some records from the library, its index, the search index, and the playlist, and
+ * their rows from the view.
+ *
+ * Each run of rows being removed goes in a single rowsRemoved(), as does each run of
+ * playlist entries, and the store's compacted once all of them are gone. Every step is a
+ * single pass over the rows (or the records), however many songs are being removed.
+ *
+ * @param records The records to remove, in any order. Repeats are ignored.
+ */
+void LibraryModel::removeFromLibrary(const QVector<int> &records)
+{
+        if (records.isEmpty()) {
+                return;
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+
+        QBitArray dead(library.size());
+        QSet<QString> paths;
+        for (int record : records) {
+                if (dead.testBit(record) || library.isRemoved(record)) {
+                        continue;
+                }
+
+                // The search index drops the removed records all at once when it's remapped
+                // in compact(), rather than one posting list entry at a time.
+                paths.insert(library.path(record));
+                removeFromIndex(record);
+                library.remove(record);
+                dead.setBit(record);
+        }
+
+        removeRecords(order, dead, filter.isEmpty());
+        if (!filter.isEmpty()) {
+                removeRecords(filtered, dead, true);
+        }
+
+        Astoria::Playlist::removeFiles(paths);
+        compact();
+
+        if (Astoria::benchmarking()) {
+                qDebug() << "Removed" << paths.size() << "songs from the library in" << timer.elapsed() << "ms";
+        }
+}
+
+/**
+ * Drop the removed records from the store for good, and follow the rest to where they've
+ * moved to. The rows themselves don't change, only the records they show.
+ */
+void LibraryModel::compact()
+{
+        const QVector<int> moved = library.compact();
+        search.remap(moved);
+        sorter.invalidate();
+
+        for (int &record : order) {
+                record = moved[record];
+        }
+        for (int &record : filtered) {
+                record = moved[record];
+        }
+        for (auto file = libraryPaths.begin(); file != libraryPaths.end(); ++file) {
+                file.value() = moved[file.value()];
+        }
+
+        QBitArray movedMatches(library.size());
+        QVector<quint8> movedDistances(distances.isEmpty() ? 0 : library.size());
+        for (int record = 0; record < moved.size(); ++record) {
+                if (moved[record] < 0) {
+                        continue;
+                }
+                if (record < matches.size() && matches.testBit(record)) {
+                        movedMatches.setBit(moved[record]);
+                }
+                if (record < distances.size() && !movedDistances.isEmpty()) {
+                        movedDistances[moved[record]] = distances[record];
+                }
+        }
+        if (!matches.isEmpty()) {
+                matches = movedMatches;
+        }
+        distances = movedDistances;
+}
+
+/**
+ * Replace records with their songs as they've been read again, e.g. because their files were
+ * edited outside of the player.
+ *
+ * Unless the library's been sorted, the rows stay where they are, and are redrawn with a
+ * single dataChanged() covering all of them. If it has, the records are taken out and put
+ * back in their sorted places. When filtering, records that stop matching are taken out,
+ * and ones that start matching are put in.
+ *
+ * @param records The records to replace.
+ * @param songs The song to replace each record with.
+ */
+void LibraryModel::replaceRecords(const QVector<int> &records, const QList<Song> &songs)
+{
+        if (records.isEmpty()) {
+                return;
+        }
+
+        QBitArray changed(library.size());
+        for (int i = 0; i < records.size(); ++i) {
+                search.remove(records[i]);
+                removeFromIndex(records[i]);
+                library.replace(records[i], songs[i]);
+                addToIndex(songs[i], records[i]);
+                search.add(records[i]);
+                changed.setBit(records[i]);
+        }
+        sorter.invalidate();
+
+        if (!sortKeys.isEmpty()) {
+                // Changed songs can be sorted anywhere, so they're put back as if they're new.
+                removeRecords(order, changed, filter.isEmpty());
+                insertRecords(order, records, filter.isEmpty());
+                if (!filter.isEmpty()) {
+                        findMatches(ranked);
+                        removeRecords(filtered, changed, true);
+                        if (ranked) {
+                                filtered += matching(records);
+                        } else {
+                                insertRecords(filtered, matching(records), true);
+                        }
+                }
+                fetchTo(rowsPerFetch);
+                return;
+        }
+
+        if (!filter.isEmpty()) {
+                findMatches(ranked);
+
+                QBitArray stopped(library.size());
+                for (int record : records) {
+                        if (!matches.testBit(record)) {
+                                stopped.setBit(record);
+                        }
+                }
+                removeRecords(filtered, stopped, true);
+
+                QBitArray shown(library.size());
+                for (int record : filtered) {
+                        shown.setBit(record);
+                }
+
+                if (ranked) {
+                        for (int record : matching(records)) {
+                                if (!shown.testBit(record)) {
+                                        filtered.append(record);
+                                }
+                        }
+                } else {
+                        // The filtered rows are in the same order as the rest of the rows, so
+                        // records that start matching go where they are in those, i.e. after
+                        // however many of the rows already shown come before them.
+                        QVector<int> started;
+                        QVector<int> positions;
+                        int row = 0;
+                        for (int record : order) {
+                                if (!matches.testBit(record)) {
+                                        continue;
+                                }
+                                if (shown.testBit(record)) {
+                                        ++row;
+                                } else {
+                                        started.append(record);
+                                        positions.append(row);
+                                }
+                        }
+                        mergeRecords(filtered, started, positions, true);
+                }
+                fetchTo(rowsPerFetch);
+        }
+
+        int first = fetched;
+        int last = -1;
+        for (int row = 0; row < fetched; ++row) {
+                if (changed.testBit(rows()[row])) {
+                        first = qMin(first, row);
+                        last = row;
+                }
+        }
+        if (last >= 0) {
+                emit dataChanged(index(first, 0), index(last, columnCount() - 1));
+        }
+}
+
+/**
+ * Put new records in their place in some rows, which is at the end unless the library has
+ * been sorted. Sorted records go in their place in the current sort order, without sorting
+ * the rest of the library again.
+ *
+ * The new records are sorted amongst themselves, and then each one is binary searched for
+ * in the rows, starting from where the one before it went, before they're all merged in
+ * together (see mergeRecords()).
+ *
+ * @param into The rows to add the records to (either order or filtered).
+ * @param records The records to add, which aren't in the rows yet.
+ * @param visible Whether the rows are the ones being shown, i.e. the view needs telling.
+ */
+void LibraryModel::insertRecords(QVector<int> &into, QVector<int> records, bool visible)
+{
+        if (records.isEmpty()) {
+                return;
+        }
+
+        if (sortKeys.isEmpty()) {
+                // Nothing after the rows that have been fetched is shown yet.
+                into += records;
+                return;
+        }
+
+        auto less = [this](int a, int b) { return sorter.lessThan(a, b, sortKeys); };
+        std::stable_sort(records.begin(), records.end(), less);
+
+        // Where each record goes in the rows as they are now. Equal songs go after the ones
+        // already there, as a stable sort would put them, and as the records are sorted each
+        // search can start from where the one before went.
+        QVector<int> positions(records.size());
+        auto from = into.cbegin();
+        for (int i = 0; i < records.size(); ++i) {
+                from = std::upper_bound(from, into.cend(), records[i], less);
+                positions[i] = static_cast<int>(from - into.cbegin());
+        }
+
+        mergeRecords(into, records, positions, visible);
+}
+
+/**
+ * Merge new records into some rows in a single pass, rather than inserting each of them and
+ * moving every row after it along.
+ *
+ * Records that go in the same place are inserted together, which keeps the number of row
+ * insertions down when a batch comes from the same album or artist. Inserting rows keeps
+ * persistent indexes valid.
+ *
+ * @param into The rows to add the records to (either order or filtered).
+ * @param records The records to add.
+ * @param positions Where each record goes, as the row it goes before in the rows as they
+ *                  are now, in order.
+ * @param visible Whether the rows are the ones being shown, i.e. the view needs telling.
+ */
+void LibraryModel::mergeRecords(QVector<int> &into, const QVector<int> &records,
+                                const QVector<int> &positions, bool visible)
+{
+        QVector<int> merged;
+        merged.reserve(into.size() + records.size());
+        int next = 0;
+        for (int row = 0; row <= into.size(); ++row) {
+                while (next < records.size() && positions[next] == row) {
+                        merged.append(records[next++]);
+                }
+                if (row < into.size()) {
+                        merged.append(into[row]);
+                }
+        }
+        into.swap(merged);
+
+        if (!visible) {
+                return;
+        }
+
+        // Each run of records going in the same place is a row insertion, from the first, so
+        // each run's row is where it was before plus everything inserted ahead of it. Nothing
+        // after the rows that have been fetched is shown yet.
+        const int shown = fetched;
+        int first = 0;
+        while (first < records.size() && positions[first] < shown) {
+                int last = first + 1;
+                while (last < records.size() && positions[last] == positions[first]) {
+                        ++last;
+                }
+
+                const int row = positions[first] + first;
+                beginInsertRows(QModelIndex(), row, row + last - first - 1);
+                fetched += last - first;
+                endInsertRows();
+
+                first = last;
+        }
+}
+
+/**
+ * Move a record to where it belongs in the current sort order, after it's changed.
+ *
+ * @param in The rows to move the record in (either order or filtered).
+ * @param from Where the record is in them.
+ * @param visible Whether the rows are the ones being shown, i.e. the view needs telling.
+ */
+void LibraryModel::moveSorted(QVector<int> &in, int from, bool visible)
+{
+        const int record = in[from];
+        QVector<int> others = in;
+        others.remove(from);
+
+        auto less = [this](int a, int b) { return sorter.lessThan(a, b, sortKeys); };
+        const int to = static_cast<int>(std::upper_bound(others.cbegin(), others.cend(), record, less)
+                                        - others.cbegin());
+        if (to == from) {
+                return;
+        }
+
+        auto move = [&in, &others, record, to]() {
+                in = others;
+                in.insert(to, record);
+        };
+
+        if (!visible || (from >= fetched && to >= fetched)) {
+                move();
+        } else if (from < fetched && to < fetched) {
+                // The destination is given as the row it goes before, counting the row being
+                // moved.
+                beginMoveRows(QModelIndex(), from, from, QModelIndex(), to > from ? to + 1 : to);
+                move();
+                endMoveRows();
+        } else if (from < fetched) {
+                // Moving past the rows that have been fetched hides it, and shows the next row.
+                beginRemoveRows(QModelIndex(), from, from);
+                move();
+                --fetched;
+                endRemoveRows();
+                fetchTo(fetched + 1);
+        } else {
+                beginInsertRows(QModelIndex(), to, to);
+                move();
+                ++fetched;
+                endInsertRows();
+        }
+}
+
+/**
+ * Move a row to where it should be in the current sort order, after its song has changed.
+ *
+ * @param row The row whose song changed.
+ */
+void LibraryModel::keepSorted(int row)
+{
+        if (sortKeys.isEmpty()) {
+                return;
+        }
+
+        if (filter.isEmpty()) {
+                moveSorted(order, row, true);
+        } else {
+                moveSorted(order, order.indexOf(filtered[row]), false);
+                if (!ranked) {
+                        moveSorted(filtered, row, true);
+                }
+        }
+}
+
+/**
+ * Take some records out of some rows. Runs of rows next to each other are removed together,
+ * starting from the end so that the rows before them don't move, and as many rows as were
+ * removed from the ones shown are shown from after them.
+ *
+ * @param from The rows to remove the records from (either order or filtered).
+ * @param records Which records to remove, by record.
+ * @param visible Whether the rows are the ones being shown, i.e. the view needs telling.
+ */
+void LibraryModel::removeRecords(QVector<int> &from, const QBitArray &records, bool visible)
+{
+        int hidden = 0;
+
+        int last = from.size();
+        while (last > 0) {
+                if (!records.testBit(from[last - 1])) {
+                        --last;
+                        continue;
+                }
+
+                int first = last - 1;
+                while (first > 0 && records.testBit(from[first - 1])) {
+                        --first;
+                }
+
+                const bool shown = visible && first < fetched;
+                if (shown) {
+                        beginRemoveRows(QModelIndex(), first, qMin(last, fetched) - 1);
+                }
+                const int removedShown = shown ? qMin(last, fetched) - first : 0;
+                from.remove(first, last - first);
+                if (shown) {
+                        fetched -= removedShown;
+                        hidden += removedShown;
+                        endRemoveRows();
+                }
+
+                last = first;
+        }
+
+        if (hidden > 0) {
+                fetchTo(fetched + hidden);
+        }
+}
+
+/**
+ * @param records Some records, in the order they're shown in.
+ * @return The records that match the filter, in the same order.
+ */
+QVector<int> LibraryModel::matching(const QVector<int> &records) const
+{
+        QVector<int> found;
+        for (int record : records) {
+                if (matches.testBit(record)) {
+                        found.append(record);
+                }
+        }
+
+        return found;
+}
+
+/**
+ * Work out which records match the filter.
+ *
+ * @param fuzzy Whether to allow for typos, in which case how close each record is to
+ *              matching is kept too.
+ */
+void LibraryModel::findMatches(bool fuzzy)
+{
+        if (!fuzzy) {
+                matches = search.find(filter);
+                return;
+        }
+
+        distances = search.fuzzyFind(filter);
+        matches = QBitArray(distances.size());
+        for (int record = 0; record < distances.size(); ++record) {
+                if (distances[record] != SearchIndex::noMatch) {
+                        matches.setBit(record);
+                }
+        }
+}
+
+/**
+ * Only show the songs matching some text, which is searched for as the user types it. Every
+ * word has to be in the song's title, artist, or album. Matching songs are found through the
+ * search index rather than by looking at every song, so the rows are narrowed down quickly
+ * even for very large libraries.
+ *
+ * If no song matches, the user has probably made a typo, so the songs that nearly match are
+ * shown instead, with the closest matches first.
+ *
+ * @param text What to search for, or nothing to show every song again.
+ */
+void LibraryModel::setFilter(const QString &text)
+{
+        QElapsedTimer timer;
+        timer.start();
+
+        // The rows can change completely from one key press to the next, so there's no point
+        // working out which rows came and went.
+        beginResetModel();
+        filter = text.trimmed();
+        ranked = false;
+        distances.clear();
+        if (filter.isEmpty()) {
+                matches.clear();
+                filtered.clear();
+        } else {
+                findMatches(false);
+                filtered = matching(order);
+
+                if (filtered.isEmpty() || Astoria::benchmarking()) {
+                        const qint64 exact = timer.elapsed();
+                        QElapsedTimer fuzzyTimer;
+                        fuzzyTimer.start();
+
+                        findMatches(true);
+                        if (Astoria::benchmarking()) {
+                                qDebug() << "Searching" << library.size() << "songs for" << filter
+                                         << "took" << exact << "ms, fuzzy matching took"
+                                         << fuzzyTimer.elapsed() << "ms";
+                        }
+
+                        if (filtered.isEmpty()) {
+                                filtered = matching(order);
+                                std::stable_sort(filtered.begin(), filtered.end(), [this](int a, int b) {
+                                        return distances[a] < distances[b];
+                                });
+                                ranked = true;
+                        } else {
+                                findMatches(false);
+                        }
+                }
+        }
+        fetched = qMin(rowsPerFetch, rows().size());
+        endResetModel();
+
+        if (Astoria::benchmarking()) {
+                qDebug() << "Found" << rows().size() << (ranked ? "songs nearly matching" : "songs matching")
+                         << filter << "in" << timer.elapsed() << "ms";
+        }
+}
+
+/**
+ * Check whether a song is already in the library. A song is considered to be in the library
+ * if the same file is, whether it's found under the same path, through a symbolic link, or
+ * as a hard link to it.
+ *
+ * @param song The song to look for.
+ */
+bool LibraryModel::isInLibrary(const Song &song) const
+{
+        if (libraryPaths.contains(song.canonicalPath.isEmpty() ? song.filePath : song.canonicalPath)) {
+                return true;
+        }
+
+        return song.inode != 0 && libraryFiles.contains(qMakePair(song.device, song.inode));
+}
+
+void LibraryModel::addToIndex(const Song &song, int record)
+{
+        libraryPaths.insert(song.canonicalPath.isEmpty() ? song.filePath : song.canonicalPath, record);
+        if (song.inode != 0) {
+                libraryFiles.insert(qMakePair(song.device, song.inode));
+        }
+}
+
+/**
+ * Forget a record's file, which has to be done before the record changes in the store.
+ */
+void LibraryModel::removeFromIndex(int record)
+{
+        const Song song = library.song(record);
+        libraryPaths.remove(song.canonicalPath.isEmpty() ? song.filePath : song.canonicalPath);
+        if (song.inode != 0) {
+                libraryFiles.remove(qMakePair(song.device, song.inode));
+        }
+}
+
+/**
+ * @param path A file's path, which is quickest to look up if it's canonical.
+ * @return The file's record, or -1 if it isn't in the library.
+ */
+int LibraryModel::recordOf(const QString &path) const
+{
+        const int record = libraryPaths.value(path, -1);
+        if (record >= 0) {
+                return record;
+        }
+
+        const QString canonicalPath = QFileInfo(path).canonicalFilePath();
+        return canonicalPath.isEmpty() || canonicalPath == path ? -1 : libraryPaths.value(canonicalPath, -1);
+}
+
+const QUrl LibraryModel::get(int row) const
+{
+        return QUrl::fromLocalFile(library.path(rows()[row]));
+}
+
+/**
+ * Sort a given column.
+ *
+ * The store itself is never reordered. Instead the rows are a permutation of its records,
+ * and it's the permutation that's sorted (see LibrarySorter). Anything holding on to a
+ * persistent index (e.g. the view's selection) is moved along with its row.
+ *
+ * @param column The column to sort.
+ */
+void LibraryModel::sortByColumn(int column)
+{
+        if (column < 0 || column >= columnCount()) {
+                return;
+        }
+
+        const Qt::SortOrder sortOrder = sort == AToZ ? Qt::AscendingOrder : Qt::DescendingOrder;
+        sort = sort == AToZ ? ZToA : AToZ;
+
+        sortBy({{columnAt(column).sortKey, sortOrder}});
+}
+
+/**
+ * Sort the library the way albums are listed, i.e. by artist, then by album, and then by
+ * where each song is on the album.
+ */
+void LibraryModel::sortByAlbum()
+{
+        sortBy({
+                {LibraryStore::Artist, Qt::AscendingOrder},
+                {LibraryStore::Album, Qt::AscendingOrder},
+                {LibraryStore::Disc, Qt::AscendingOrder},
+                {LibraryStore::Track, Qt::AscendingOrder},
+        });
+}
+
+/**
+ * Reorder the rows by some fields, keeping any persistent indexes (e.g. the selection)
+ * pointing at the same songs.
+ *
+ * @param keys The fields to sort by, most significant first.
+ */
+void LibraryModel::sortBy(const QVector<LibrarySorter::SortKey> &keys)
+{
+        QElapsedTimer timer;
+        timer.start();
+
+        const QVector<int> sorted = sorter.sort(order, keys);
+        const qint64 elapsed = timer.elapsed();
+
+        if (Astoria::benchmarking()) {
+                // The same ranks, compared field by field instead of radix sorted.
+                timer.restart();
+                QVector<int> compared = order;
+                std::stable_sort(compared.begin(), compared.end(), [this, &keys](int a, int b) {
+                        for (const auto &key : keys) {
+                                const QVector<quint32> &ranks = sorter.ranks(key.field);
+                                if (ranks[a] != ranks[b]) {
+                                        return (ranks[a] < ranks[b]) != (key.order == Qt::DescendingOrder);
+                                }
+                        }
+                        return false;
+                });
+
+                qDebug() << "Radix sort:" << elapsed << "ms, std::stable_sort:" << timer.elapsed()
+                         << "ms" << (compared == sorted ? "(same order)" : "(different order!)");
+        }
+
+        const QVector<int> shown = filter.isEmpty() ? sorted : matching(sorted);
+
+        QVector<int> newRows(library.size());
+        for (int row = 0; row < shown.size(); ++row) {
+                newRows[shown[row]] = row;
+        }
+
+        // Anything the view is holding on to (e.g. the current row) has to stay in the rows
+        // that are shown, wherever it's sorted to.
+        int needed = 0;
+        for (const auto &persistent : persistentIndexList()) {
+                needed = qMax(needed, newRows[rows()[persistent.row()]] + 1);
+        }
+        fetchTo(needed);
+
+        emit layoutAboutToBeChanged(QList<QPersistentModelIndex>(), QAbstractItemModel::VerticalSortHint);
+
+        const QModelIndexList from = persistentIndexList();
+        QModelIndexList to;
+        to.reserve(from.size());
+        for (const auto &persistent : from) {
+                to.append(index(newRows[rows()[persistent.row()]], persistent.column()));
+        }
+
+        order = sorted;
+        if (!filter.isEmpty()) {
+                filtered = shown;
+        }
+        sortKeys = keys;
+        ranked = false;
+        changePersistentIndexList(from, to);
+
+        emit layoutChanged(QList<QPersistentModelIndex>(), QAbstractItemModel::VerticalSortHint);
+
+        if (Astoria::benchmarking()) {
+                qDebug() << "Sorted" << order.size() << "songs by" << keys.size() << "field(s) in"
+                         << elapsed << "ms";
+        }
+}
+
+/*
  * If the user decides to update the metadata of a file, we need to reflect the change
  * in the library, as well as anything connected to the current media, assuming the file
  * edited was the current playing song.
  */
 void LibraryModel::updateMetadata()
 {
-        Song song(library.at(mightBeUpdated.row()));
-        library.removeAt(mightBeUpdated.row());
-        library.insert(mightBeUpdated.row(), song);
-        emit dataChanged(QModelIndex(), QModelIndex());
+        // The song's row may have moved, or gone, while its metadata was being edited.
+        if (!mightBeUpdated.isValid() || mightBeUpdated.row() >= rows().size()) {
+                return;
+        }
+
+        const int row = mightBeUpdated.row();
+        const int record = rows()[row];
+        Song song = library.song(record);
+        song.updateMetadata(library.properties());
 
-        if (library.at(mightBeUpdated.row()).filePath == Astoria::getCurrentSong().toString().remove(0, 7)) {
+        search.remove(record);
+        library.replace(record, song);
+        search.add(record);
+        sorter.invalidate();
+        emit dataChanged(index(row, 0), index(row, columnCount() - 1));
+        keepSorted(row);
+
+        // The song's old path and title are left behind in the store.
+        if (library.needsCompacting()) {
+                compact();
+        }
+
+        if (song.filePath == Astoria::getCurrentSong().toString().remove(0, 7)) {
                 /* The current song was edited, so we need to update the following:
                  *      - Duration
                  *      - Window Title
@@ -245,6 +1461,33 @@ void LibraryModel::updateMetadata()
         }
 }
 
+/**
+ * Save the library to disk, so that it can be restored the next time the program starts.
+ */
+void LibraryModel::saveCache()
+{
+        saveTimer.stop();
+
+        QElapsedTimer timer;
+        timer.start();
+
+        const bool saved = LibraryCache::save(LibraryCache::defaultLocation(), library);
+        if (Astoria::benchmarking()) {
+                if (saved) {
+                        qDebug() << "Saved" << library.size() << "songs to the library cache in" << timer.elapsed()
+                                 << "ms";
+                }
+                if (library.size() > 0) {
+                        qDebug() << "The library is using" << library.memoryUsage() / library.size()
+                                 << "bytes per song";
+                }
+        }
+
+        // The cache we have mapped is now out of date, it'll be mapped again before the
+        // next scan.
+        cache.reset();
+}
+
 void LibraryModel::indexMightBeUpdated(const QModelIndex &index)
 {
         mightBeUpdated = index;
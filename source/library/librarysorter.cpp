@@ -0,0 +1,404 @@
+#include "includes/library/librarysorter.hpp"
+
+#include <QThread>
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "includes/library/workstealingpool.hpp"
+
+// Radix sorting 11 bits at a time keeps the counts for each pass small enough to stay in
+// cache, while still only needing 3 passes for a 32 bit rank.
+static constexpr int digitBits = 11;
+static constexpr int digitBuckets = 1 << digitBits;
+
+// Below this many records, handing the work out to other threads costs more than it saves.
+static constexpr int parallelThreshold = 1 << 16;
+
+/**
+ * @return How many bits it takes to hold value.
+ */
+static int bitsFor(quint32 value)
+{
+        int bits = 0;
+        while (value > 0) {
+                ++bits;
+                value >>= 1;
+        }
+
+        return bits;
+}
+
+/**
+ * Work out the rank of each of count values, where equal values share a rank, and ranks
+ * have no gaps between them.
+ *
+ * @param count How many values there are.
+ * @param less Whether the value at one index comes before the value at another.
+ * @param equal Whether the values at two indexes are equal.
+ * @return The rank of each value.
+ */
+template <typename Less, typename Equal>
+static QVector<quint32> denseRanks(int count, Less less, Equal equal)
+{
+        QVector<int> sorted(count);
+        std::iota(sorted.begin(), sorted.end(), 0);
+        std::sort(sorted.begin(), sorted.end(), less);
+
+        QVector<quint32> ranks(count);
+        quint32 rank = 0;
+        for (int i = 0; i < count; ++i) {
+                if (i > 0 && !equal(sorted[i - 1], sorted[i])) {
+                        ++rank;
+                }
+                ranks[sorted[i]] = rank;
+        }
+
+        return ranks;
+}
+
+static QVector<quint32> rankSortKeys(const std::vector<QCollatorSortKey> &keys)
+{
+        auto key = [&keys](int index) -> const QCollatorSortKey & {
+                return keys[static_cast<std::size_t>(index)];
+        };
+
+        return denseRanks(static_cast<int>(keys.size()),
+                          [&key](int a, int b) { return key(a).compare(key(b)) < 0; },
+                          [&key](int a, int b) { return key(a).compare(key(b)) == 0; });
+}
+
+LibrarySorter::LibrarySorter(const LibraryStore &t_library)
+        : library(t_library),
+          fieldRanks(LibraryStore::FieldCount)
+{
+        collator.setCaseSensitivity(Qt::CaseInsensitive);
+        collator.setNumericMode(true);
+}
+
+LibrarySorter::~LibrarySorter() = default;
+
+/**
+ * Throw away every rank that's been worked out, as the store has changed.
+ */
+void LibrarySorter::invalidate()
+{
+        for (auto &ranks : fieldRanks) {
+                ranks.clear();
+        }
+}
+
+/**
+ * @param field The field to rank the records by.
+ * @return The rank of each record's value in the field.
+ */
+const QVector<quint32> &LibrarySorter::ranks(LibraryStore::Field field)
+{
+        QVector<quint32> &ranks = fieldRanks[field];
+        if (ranks.size() != library.size()) {
+                ranks = rankRecords(field);
+        }
+
+        return ranks;
+}
+
+/**
+ * Sort records by several fields, e.g. by artist, and then by album for songs by the same
+ * artist, and so on. The sort is stable.
+ *
+ * Each field's ranks only need as many bits as it takes to hold the highest rank, so as
+ * many fields as fit are packed into one 64 bit key, most significant field first. If they
+ * don't all fit, the least significant fields are sorted by first, which works because each
+ * sort is stable.
+ *
+ * @param records The records to sort.
+ * @param keys The fields to sort by, most significant first.
+ * @return The records in sorted order.
+ */
+QVector<int> LibrarySorter::sort(const QVector<int> &records, const QVector<SortKey> &keys)
+{
+        struct Column
+        {
+                const QVector<quint32> *ranks;
+                quint32 highest;
+                int bits;
+                bool descending;
+        };
+
+        QVector<Column> columns;
+        columns.reserve(keys.size());
+        for (const SortKey &key : keys) {
+                const QVector<quint32> &fieldRanks = ranks(key.field);
+                quint32 highest = 0;
+                for (int record : records) {
+                        highest = qMax(highest, fieldRanks[record]);
+                }
+                columns.append({&fieldRanks, highest, bitsFor(highest),
+                                key.order == Qt::DescendingOrder});
+        }
+
+        std::vector<int> sorted(records.begin(), records.end());
+        std::vector<quint64> packed(sorted.size());
+
+        int last = columns.size();
+        while (last > 0) {
+                int first = last;
+                int bits = 0;
+                while (first > 0 && bits + columns[first - 1].bits <= 64) {
+                        bits += columns[--first].bits;
+                }
+
+                for (std::size_t i = 0; i < sorted.size(); ++i) {
+                        quint64 key = 0;
+                        for (int column = first; column < last; ++column) {
+                                const Column &c = columns[column];
+                                const quint32 rank = (*c.ranks)[sorted[i]];
+                                key = (key << c.bits) | (c.descending ? c.highest - rank : rank);
+                        }
+                        packed[i] = key;
+                }
+
+                radixSort(packed, sorted, bits);
+                last = first;
+        }
+
+        return QVector<int>::fromStdVector(sorted);
+}
+
+/**
+ * Compare two records by their values, rather than by their ranks. This is a lot slower
+ * per comparison, but doesn't need the ranks to be up to date, so it's what to use when
+ * only a few records need placing amongst the rest (e.g. songs that have just been found).
+ *
+ * @param a A record.
+ * @param b Another record.
+ * @param keys The fields to compare by, most significant first.
+ * @return Whether a is sorted before b.
+ */
+bool LibrarySorter::lessThan(int a, int b, const QVector<SortKey> &keys) const
+{
+        for (const SortKey &key : keys) {
+                const int comparison = compare(a, b, key.field);
+                if (comparison != 0) {
+                        return key.order == Qt::DescendingOrder ? comparison > 0 : comparison < 0;
+                }
+        }
+
+        return false;
+}
+
+/**
+ * @return Less than, equal to, or greater than 0 if a's value of the field is before, the
+ *         same as, or after b's.
+ */
+int LibrarySorter::compare(int a, int b, LibraryStore::Field field) const
+{
+        auto byNumber = [](int x, int y) { return (x > y) - (x < y); };
+
+        // Records that share an interned string don't need the collator to tell them apart.
+        auto byId = [this](quint32 x, quint32 y, const StringPool &pool) {
+                return x == y ? 0 : collator.compare(pool.string(x), pool.string(y));
+        };
+
+        switch (field) {
+        case LibraryStore::Title:
+                return collator.compare(library.title(a), library.title(b));
+        case LibraryStore::Artist:
+                return byId(library.artistId(a), library.artistId(b), library.artistPool());
+        case LibraryStore::Album:
+                return byId(library.albumId(a), library.albumId(b), library.albumPool());
+        case LibraryStore::Genre:
+                return byId(library.genreId(a), library.genreId(b), library.genrePool());
+        case LibraryStore::Track:
+                return byNumber(library.track(a), library.track(b));
+        case LibraryStore::Year:
+                return byNumber(library.year(a), library.year(b));
+        case LibraryStore::Duration:
+                return byNumber(library.duration(a), library.duration(b));
+        case LibraryStore::Disc:
+                return byNumber(library.disc(a), library.disc(b));
+        case LibraryStore::Composer:
+                return byId(library.composerId(a), library.composerId(b), library.composerPool());
+        case LibraryStore::Comment:
+                return byId(library.commentId(a), library.commentId(b), library.commentPool());
+        case LibraryStore::Bpm:
+                return byNumber(library.bpm(a), library.bpm(b));
+        case LibraryStore::Bitrate:
+                return byNumber(library.bitrate(a), library.bitrate(b));
+        case LibraryStore::SampleRate:
+                return byNumber(library.sampleRate(a), library.sampleRate(b));
+        case LibraryStore::FieldCount:
+                break;
+        }
+
+        return 0;
+}
+
+/**
+ * A stable LSD radix sort of records by their keys, a digit at a time. Big sorts are split
+ * into a chunk per worker: each worker counts the digits in its chunk, and as the counts
+ * say exactly where each chunk's records for each digit go, every worker can then move its
+ * chunk's records without having to wait on anybody else.
+ *
+ * @param keys The key for each record, which is sorted along with the records.
+ * @param records The records to sort.
+ * @param bits How many of the low bits of the keys are used.
+ */
+void LibrarySorter::radixSort(std::vector<quint64> &keys, std::vector<int> &records, int bits)
+{
+        const int count = static_cast<int>(keys.size());
+        const int chunks = count >= parallelThreshold ? workers().threadCount() : 1;
+        const int chunkSize = (count + chunks - 1) / chunks;
+
+        auto forEachChunk = [this, chunks, chunkSize, count](const auto &work) {
+                auto run = [&work, chunkSize, count](int chunk) {
+                        work(chunk, chunk * chunkSize, qMin(count, (chunk + 1) * chunkSize));
+                };
+
+                if (chunks == 1) {
+                        run(0);
+                        return;
+                }
+
+                for (int chunk = 0; chunk < chunks; ++chunk) {
+                        workers().submit([&run, chunk](int) { run(chunk); });
+                }
+                workers().wait();
+        };
+
+        std::vector<quint64> sortedKeys(keys.size());
+        std::vector<int> sortedRecords(records.size());
+        std::vector<int> offsets(static_cast<std::size_t>(chunks * digitBuckets));
+
+        for (int shift = 0; shift < bits; shift += digitBits) {
+                auto digit = [shift](quint64 key) {
+                        return static_cast<int>((key >> shift) & (digitBuckets - 1));
+                };
+
+                std::fill(offsets.begin(), offsets.end(), 0);
+                forEachChunk([&](int chunk, int begin, int end) {
+                        int *counts = &offsets[static_cast<std::size_t>(chunk * digitBuckets)];
+                        for (int i = begin; i < end; ++i) {
+                                ++counts[digit(keys[static_cast<std::size_t>(i)])];
+                        }
+                });
+
+                // Turn the counts into where each chunk starts putting each digit. If every
+                // record has the same digit then this pass wouldn't move anything.
+                bool uniform = false;
+                int position = 0;
+                for (int bucket = 0; bucket < digitBuckets; ++bucket) {
+                        const int bucketStart = position;
+                        for (int chunk = 0; chunk < chunks; ++chunk) {
+                                int &offset = offsets[static_cast<std::size_t>(chunk * digitBuckets + bucket)];
+                                const int counted = offset;
+                                offset = position;
+                                position += counted;
+                        }
+                        uniform = uniform || position - bucketStart == count;
+                }
+
+                if (uniform) {
+                        continue;
+                }
+
+                forEachChunk([&](int chunk, int begin, int end) {
+                        int *starts = &offsets[static_cast<std::size_t>(chunk * digitBuckets)];
+                        for (int i = begin; i < end; ++i) {
+                                const quint64 key = keys[static_cast<std::size_t>(i)];
+                                const auto to = static_cast<std::size_t>(starts[digit(key)]++);
+                                sortedKeys[to] = key;
+                                sortedRecords[to] = records[static_cast<std::size_t>(i)];
+                        }
+                });
+
+                keys.swap(sortedKeys);
+                records.swap(sortedRecords);
+        }
+}
+
+WorkStealingPool &LibrarySorter::workers()
+{
+        if (!pool) {
+                pool.reset(new WorkStealingPool(QThread::idealThreadCount()));
+        }
+
+        return *pool;
+}
+
+/**
+ * Rank the strings in a pool, according to the collator.
+ */
+QVector<quint32> LibrarySorter::rankStrings(const StringPool &pool)
+{
+        // QCollatorSortKey can't be default constructed, which QVector wants.
+        std::vector<QCollatorSortKey> keys;
+        keys.reserve(static_cast<std::size_t>(pool.size()));
+        for (int id = 0; id < pool.size(); ++id) {
+                keys.push_back(collator.sortKey(pool.string(static_cast<quint32>(id))));
+        }
+
+        return rankSortKeys(keys);
+}
+
+QVector<quint32> LibrarySorter::rankRecords(LibraryStore::Field field)
+{
+        const int count = library.size();
+
+        // Interned fields are ranked by ID, and then each record takes the rank of its ID.
+        auto byId = [this, count](const StringPool &pool, quint32 (LibraryStore::*id)(int) const) {
+                const QVector<quint32> idRanks = rankStrings(pool);
+                QVector<quint32> ranks(count);
+                for (int record = 0; record < count; ++record) {
+                        ranks[record] = idRanks[static_cast<int>((library.*id)(record))];
+                }
+                return ranks;
+        };
+
+        auto byNumber = [count](auto value) {
+                return denseRanks(count,
+                                  [&value](int a, int b) { return value(a) < value(b); },
+                                  [&value](int a, int b) { return value(a) == value(b); });
+        };
+
+        switch (field) {
+        case LibraryStore::Title: {
+                std::vector<QCollatorSortKey> keys;
+                keys.reserve(static_cast<std::size_t>(count));
+                for (int record = 0; record < count; ++record) {
+                        keys.push_back(collator.sortKey(library.title(record)));
+                }
+
+                return rankSortKeys(keys);
+        }
+        case LibraryStore::Artist:
+                return byId(library.artistPool(), &LibraryStore::artistId);
+        case LibraryStore::Album:
+                return byId(library.albumPool(), &LibraryStore::albumId);
+        case LibraryStore::Genre:
+                return byId(library.genrePool(), &LibraryStore::genreId);
+        case LibraryStore::Track:
+                return byNumber([this](int record) { return library.track(record); });
+        case LibraryStore::Year:
+                return byNumber([this](int record) { return library.year(record); });
+        case LibraryStore::Duration:
+                return byNumber([this](int record) { return library.duration(record); });
+        case LibraryStore::Disc:
+                return byNumber([this](int record) { return library.disc(record); });
+        case LibraryStore::Composer:
+                return byId(library.composerPool(), &LibraryStore::composerId);
+        case LibraryStore::Comment:
+                return byId(library.commentPool(), &LibraryStore::commentId);
+        case LibraryStore::Bpm:
+                return byNumber([this](int record) { return library.bpm(record); });
+        case LibraryStore::Bitrate:
+                return byNumber([this](int record) { return library.bitrate(record); });
+        case LibraryStore::SampleRate:
+                return byNumber([this](int record) { return library.sampleRate(record); });
+        case LibraryStore::FieldCount:
+                break;
+        }
+
+        return QVector<quint32>(count, 0);
+}
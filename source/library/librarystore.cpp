@@ -0,0 +1,344 @@
+#include "includes/library/librarystore.hpp"
+
+#include <limits>
+
+template <typename T>
+static T clamp(int value)
+{
+        return static_cast<T>(qBound(0, value, static_cast<int>(std::numeric_limits<T>::max())));
+}
+
+void LibraryStore::reserve(int count)
+{
+        paths.reserve(count);
+        canonicalPaths.reserve(count);
+        titles.reserve(count);
+        artistIds.reserve(count);
+        albumIds.reserve(count);
+        genreIds.reserve(count);
+        years.reserve(count);
+        tracks.reserve(count);
+        discs.reserve(count);
+        durations.reserve(count);
+        devices.reserve(count);
+        inodes.reserve(count);
+        sizes.reserve(count);
+        modifiedTimes.reserve(count);
+}
+
+/**
+ * Choose which of the metadata that's only read when asked for is stored. Turning a
+ * property on gives every record an empty value for it, to be filled in with
+ * updateProperties(), and turning one off throws its column away.
+ *
+ * @param properties The properties to store.
+ */
+void LibraryStore::setProperties(Song::Properties properties)
+{
+        auto resize = [this, properties](Song::Property property, auto &column) {
+                if (properties & property) {
+                        column.resize(size());
+                } else {
+                        column.clear();
+                        column.squeeze();
+                }
+        };
+
+        resize(Song::Composer, composerIds);
+        resize(Song::Comment, commentIds);
+        resize(Song::Bpm, bpms);
+        resize(Song::Bitrate, bitrates);
+        resize(Song::SampleRate, sampleRates);
+
+        // Nothing refers to the strings any more, so they can go too.
+        if (!(properties & Song::Composer)) {
+                composers = StringPool();
+        }
+        if (!(properties & Song::Comment)) {
+                comments = StringPool();
+        }
+
+        storedProperties = properties;
+}
+
+/**
+ * Fill in some of the metadata that's only read when asked for, for a record whose song
+ * has been read again just for that metadata. Properties that aren't stored are ignored,
+ * apart from the duration, which is always stored.
+ *
+ * @param record The record to update.
+ * @param song The song, holding the properties.
+ * @param properties Which of the song's properties to update the record with.
+ */
+void LibraryStore::updateProperties(int record, const Song &song, Song::Properties properties)
+{
+        if (properties & Song::Duration) {
+                durations[record] = static_cast<quint32>(qMax(song.duration, 0));
+        }
+
+        properties &= storedProperties;
+
+        if (properties & Song::Composer) {
+                composerIds[record] = composers.intern(song.composer);
+        }
+        if (properties & Song::Comment) {
+                commentIds[record] = comments.intern(song.comment);
+        }
+        if (properties & Song::Bpm) {
+                bpms[record] = clamp<quint16>(song.bpm);
+        }
+        if (properties & Song::Bitrate) {
+                bitrates[record] = clamp<quint16>(song.bitrate);
+        }
+        if (properties & Song::SampleRate) {
+                sampleRates[record] = static_cast<quint32>(qMax(song.sampleRate, 0));
+        }
+}
+
+/**
+ * Add a song to the end of the store.
+ *
+ * @param song The song to add.
+ * @return The song's record.
+ */
+int LibraryStore::append(const Song &song)
+{
+        const int record = size();
+
+        paths.append(0);
+        canonicalPaths.append(0);
+        titles.append(0);
+        artistIds.append(0);
+        albumIds.append(0);
+        genreIds.append(0);
+        years.append(0);
+        tracks.append(0);
+        discs.append(0);
+        durations.append(0);
+        devices.append(0);
+        inodes.append(0);
+        sizes.append(0);
+        modifiedTimes.append(0);
+
+        if (storedProperties & Song::Composer) {
+                composerIds.append(0);
+        }
+        if (storedProperties & Song::Comment) {
+                commentIds.append(0);
+        }
+        if (storedProperties & Song::Bpm) {
+                bpms.append(0);
+        }
+        if (storedProperties & Song::Bitrate) {
+                bitrates.append(0);
+        }
+        if (storedProperties & Song::SampleRate) {
+                sampleRates.append(0);
+        }
+
+        set(record, song);
+        return record;
+}
+
+/**
+ * Replace a record with a song that's been read again (e.g. after its tags were edited, or
+ * its file changed under the watcher).
+ *
+ * The record's old path and title are left behind in the text pool, until compact() drops
+ * them. Its old artist, album, etc. stay interned, but those pools only ever hold each
+ * distinct string once.
+ */
+void LibraryStore::replace(int record, const Song &song)
+{
+        staleText += textLength(record);
+        set(record, song);
+}
+
+/**
+ * Remove a record. The record stays where it is, so nothing else moves, but it's no longer
+ * counted or saved. Its path and title are left behind in the text pool, like they are
+ * when a record is replaced.
+ */
+void LibraryStore::remove(int record)
+{
+        if (isRemoved(record)) {
+                return;
+        }
+
+        staleText += textLength(record);
+
+        if (record >= removed.size()) {
+                removed.resize(record + 1);
+        }
+        removed.setBit(record);
+        ++removedCount;
+}
+
+/**
+ * Drop the records that have been removed, moving each record after them down to fill the
+ * gaps. Every column is squeezed in a single pass, and records keep their order, so
+ * anything sorted by record stays sorted.
+ *
+ * Once most of the text pool is the paths and titles of removed and replaced records, it's
+ * rebuilt from the records that are left, so that they don't build up over a long session.
+ * The interned pools are kept as they are, as the search index refers to their IDs.
+ *
+ * @return Where each record has moved to, or -1 for the records that were removed.
+ */
+QVector<int> LibraryStore::compact()
+{
+        QVector<int> moved(size());
+        int kept = 0;
+        for (int record = 0; record < size(); ++record) {
+                moved[record] = isRemoved(record) ? -1 : kept++;
+        }
+
+        if (removedCount == 0) {
+                compactText();
+                return moved;
+        }
+
+        // Records only ever move down, so each column can be squeezed in place.
+        auto squeeze = [&moved, kept](auto &column) {
+                if (column.isEmpty()) {
+                        return;
+                }
+                for (int record = 0; record < moved.size(); ++record) {
+                        if (moved[record] >= 0) {
+                                column[moved[record]] = column[record];
+                        }
+                }
+                column.resize(kept);
+        };
+
+        squeeze(paths);
+        squeeze(canonicalPaths);
+        squeeze(titles);
+        squeeze(artistIds);
+        squeeze(albumIds);
+        squeeze(genreIds);
+        squeeze(years);
+        squeeze(tracks);
+        squeeze(discs);
+        squeeze(durations);
+        squeeze(devices);
+        squeeze(inodes);
+        squeeze(sizes);
+        squeeze(modifiedTimes);
+        squeeze(composerIds);
+        squeeze(commentIds);
+        squeeze(bpms);
+        squeeze(bitrates);
+        squeeze(sampleRates);
+
+        removed.clear();
+        removedCount = 0;
+
+        compactText();
+        return moved;
+}
+
+/**
+ * @return Whether enough has been removed or replaced that compact() is worth calling,
+ *         i.e. there are records to drop, or most of the text pool is left over strings.
+ */
+bool LibraryStore::needsCompacting() const
+{
+        return removedCount > 0 || isTextStale();
+}
+
+/**
+ * Copy the paths and titles the records use into a new text pool, leaving behind the ones
+ * nothing uses any more.
+ */
+void LibraryStore::compactText()
+{
+        if (!isTextStale()) {
+                return;
+        }
+
+        StringPool compacted;
+        for (int record = 0; record < size(); ++record) {
+                paths[record] = compacted.copy(text, paths[record]);
+                canonicalPaths[record] = compacted.copy(text, canonicalPaths[record]);
+                titles[record] = compacted.copy(text, titles[record]);
+        }
+
+        text = compacted;
+        staleText = 0;
+}
+
+/**
+ * @return How many bytes of the text pool a record uses.
+ */
+qint64 LibraryStore::textLength(int record) const
+{
+        return text.length(paths[record]) + text.length(canonicalPaths[record]) + text.length(titles[record]);
+}
+
+/**
+ * Rebuild a whole song from its record.
+ */
+Song LibraryStore::song(int record) const
+{
+        Song song;
+        song.filePath = path(record);
+        song.title = title(record);
+        song.artist = artist(record);
+        song.album = album(record);
+        song.genre = genre(record);
+        song.year = year(record);
+        song.track = track(record);
+        song.disc = disc(record);
+        song.duration = duration(record);
+        song.canonicalPath = canonicalPath(record);
+        song.device = devices[record];
+        song.inode = inodes[record];
+        song.size = sizes[record];
+        song.modified = modifiedTimes[record];
+        song.composer = composer(record);
+        song.comment = comment(record);
+        song.bpm = bpm(record);
+        song.bitrate = bitrate(record);
+        song.sampleRate = sampleRate(record);
+
+        return song;
+}
+
+/**
+ * @return Roughly how many bytes the store is using.
+ */
+qint64 LibraryStore::memoryUsage() const
+{
+        const qint64 perRecord = static_cast<qint64>(6 * sizeof(quint32) + 3 * sizeof(quint16) +
+                                                     sizeof(quint32) + 2 * sizeof(quint64) +
+                                                     2 * sizeof(qint64));
+
+        const qint64 properties = static_cast<qint64>(
+                (composerIds.capacity() + commentIds.capacity() + sampleRates.capacity()) * sizeof(quint32) +
+                (bpms.capacity() + bitrates.capacity()) * sizeof(quint16));
+
+        return paths.capacity() * perRecord + text.memoryUsage() + artists.memoryUsage() +
+               albums.memoryUsage() + genres.memoryUsage() + properties +
+               composers.memoryUsage() + comments.memoryUsage();
+}
+
+void LibraryStore::set(int record, const Song &song)
+{
+        paths[record] = text.append(song.filePath);
+        canonicalPaths[record] = song.canonicalPath == song.filePath ? 0 : text.append(song.canonicalPath);
+        titles[record] = text.append(song.title);
+        artistIds[record] = artists.intern(song.artist);
+        albumIds[record] = albums.intern(song.album);
+        genreIds[record] = genres.intern(song.genre);
+        years[record] = clamp<quint16>(song.year);
+        tracks[record] = clamp<quint16>(song.track);
+        discs[record] = clamp<quint16>(song.disc);
+        durations[record] = static_cast<quint32>(qMax(song.duration, 0));
+        devices[record] = song.device;
+        inodes[record] = song.inode;
+        sizes[record] = song.size;
+        modifiedTimes[record] = song.modified;
+
+        updateProperties(record, song, storedProperties);
+}
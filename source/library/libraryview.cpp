@@ -1,6 +1,7 @@
 #include "includes/library/libraryview.hpp"
 
 #include <QHeaderView>
+#include <QKeyEvent>
 
 LibraryView::LibraryView(QWidget *parent, QAbstractItemModel *library)
         : QTableView(parent)
@@ -22,6 +23,7 @@ LibraryView::LibraryView(QWidget *parent, QAbstractItemModel *library)
         horizontalHeader()->setFrameRect(QRect());
         verticalHeader()->setVisible(false);
         setContextMenuPolicy(Qt::CustomContextMenu);
+        horizontalHeader()->setContextMenuPolicy(Qt::CustomContextMenu);
         setSelectionBehavior(QAbstractItemView::SelectRows);
         setShowGrid(false);
         setFrameShape(QFrame::NoFrame);
@@ -37,6 +39,19 @@ void LibraryView::entry(const QModelIndex &index)
         currentIndex = index.row();
 }
 
+/**
+ * The delete key asks for the selected songs to be removed from the library.
+ */
+void LibraryView::keyPressEvent(QKeyEvent *event)
+{
+        if (event->matches(QKeySequence::Delete)) {
+                emit removeRequested();
+                return;
+        }
+
+        QTableView::keyPressEvent(event);
+}
+
 void LibraryView::setDelegate(int row, bool doHover)
 {
         if (doHover) {
@@ -0,0 +1,488 @@
+#include "includes/library/librarywatcher.hpp"
+
+#include <QFileInfo>
+#include <QFile>
+#include <QDebug>
+
+#include <cerrno>
+#include <cstring>
+#include <limits>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "includes/library/prefetchedstream.hpp"
+#include "includes/astoria.hpp"
+
+// How long things have to be quiet for before the changes are read, and the longest a
+// change waits to be read while they aren't.
+static constexpr qint64 quietPeriod = 500;
+static constexpr qint64 maxLatency = 5000;
+
+// How often roots that can't be watched are walked again.
+static constexpr qint64 pollInterval = 30000;
+
+#ifdef __linux__
+static constexpr quint32 watchMask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE;
+#endif
+
+/**
+ * Walk a directory tree, calling visitDirectory(path) for each directory (starting with the
+ * first), and visitFile(path, directory, name) for each file. Like the scanner, symbolic
+ * links are followed for files, but not for directories.
+ *
+ * @return False if visitDirectory() returned false, which stops the walk.
+ */
+template <typename VisitDirectory, typename VisitFile>
+static bool walk(const QByteArray &path, VisitDirectory visitDirectory, VisitFile visitFile)
+{
+        if (!visitDirectory(path)) {
+                return false;
+        }
+
+        DIR *directory = opendir(path.constData());
+        if (directory == nullptr) {
+                return true;
+        }
+
+        const QByteArray prefix = path.endsWith('/') ? path : path + '/';
+        QList<QByteArray> subDirectories;
+        while (dirent *entry = readdir(directory)) {
+                const char *name = entry->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                        continue;
+                }
+
+                bool isDirectory = entry->d_type == DT_DIR;
+                bool isFile = entry->d_type == DT_REG || entry->d_type == DT_LNK;
+
+                struct stat status;
+                if (entry->d_type == DT_UNKNOWN) {
+                        if (fstatat(dirfd(directory), name, &status, AT_SYMLINK_NOFOLLOW) != 0) {
+                                continue;
+                        }
+                        isDirectory = S_ISDIR(status.st_mode);
+                        isFile = S_ISREG(status.st_mode) || S_ISLNK(status.st_mode);
+                }
+
+                if (isDirectory) {
+                        subDirectories.append(prefix + name);
+                } else if (isFile) {
+                        visitFile(prefix + name, dirfd(directory), name);
+                }
+        }
+        closedir(directory);
+
+        for (const QByteArray &subDirectory : subDirectories) {
+                if (!walk(subDirectory, visitDirectory, visitFile)) {
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+/**
+ * @param nameFilters The files to watch for, e.g. "*.mp3".
+ */
+LibraryWatcher::LibraryWatcher(const QStringList &nameFilters, QObject *parent)
+        : QThread(parent),
+          properties(0),
+          stopping(false),
+          inotifyFd(-1),
+          lastPoll(0),
+          firstChange(-1),
+          lastChange(-1)
+{
+        for (const auto &filter : nameFilters) {
+                suffixes.insert(filter.mid(filter.lastIndexOf('.') + 1).toLower().toUtf8());
+        }
+
+        if (pipe(wakePipe) != 0) {
+                wakePipe[0] = wakePipe[1] = -1;
+        } else {
+                for (int fd : wakePipe) {
+                        fcntl(fd, F_SETFL, O_NONBLOCK);
+                        fcntl(fd, F_SETFD, FD_CLOEXEC);
+                }
+        }
+}
+
+LibraryWatcher::~LibraryWatcher()
+{
+        stop();
+        wait();
+
+        for (int fd : wakePipe) {
+                if (fd >= 0) {
+                        close(fd);
+                }
+        }
+}
+
+/**
+ * Start watching a directory, and everything under it. Can be called from any thread.
+ */
+void LibraryWatcher::watch(const QString &directory)
+{
+        const QString root = QFileInfo(directory).canonicalFilePath();
+        if (root.isEmpty()) {
+                return;
+        }
+
+        {
+                std::lock_guard<std::mutex> lock(rootsMutex);
+                newRoots.append(QFile::encodeName(root));
+        }
+        wake();
+}
+
+/**
+ * Choose which of the metadata that's only read when asked for is read for changed files,
+ * which should be whatever the library's storing.
+ */
+void LibraryWatcher::setProperties(Song::Properties t_properties)
+{
+        properties = static_cast<int>(t_properties);
+}
+
+void LibraryWatcher::stop()
+{
+        stopping = true;
+        wake();
+}
+
+void LibraryWatcher::wake()
+{
+        if (wakePipe[1] >= 0) {
+                const char byte = 0;
+                const ssize_t written = write(wakePipe[1], &byte, 1);
+                (void) written;
+        }
+}
+
+void LibraryWatcher::run()
+{
+        qRegisterMetaType<LibraryDelta>("LibraryDelta");
+        clock.start();
+
+#ifdef __linux__
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFd < 0) {
+                qDebug() << "Couldn't start inotify, the library's directories will be polled instead:"
+                         << strerror(errno);
+        }
+#endif
+
+        while (!stopping) {
+                QList<QByteArray> added;
+                {
+                        std::lock_guard<std::mutex> lock(rootsMutex);
+                        added.swap(newRoots);
+                }
+                for (const QByteArray &root : added) {
+                        addRoot(root);
+                }
+
+                struct pollfd fds[2] = {
+                        {wakePipe[0], POLLIN, 0},
+                        {inotifyFd, POLLIN, 0},
+                };
+                if (poll(fds, 2, timeout()) < 0 && errno != EINTR) {
+                        break;
+                }
+
+                if (fds[0].revents & POLLIN) {
+                        char buffer[64];
+                        while (read(wakePipe[0], buffer, sizeof(buffer)) > 0) {
+                        }
+                }
+                if (fds[1].revents & POLLIN) {
+                        readEvents();
+                }
+
+                const qint64 now = clock.elapsed();
+                if (!polled.isEmpty() && now - lastPoll >= pollInterval) {
+                        pollRoots();
+                }
+                if (firstChange >= 0 && (now - lastChange >= quietPeriod || now - firstChange >= maxLatency)) {
+                        flush();
+                }
+        }
+
+        if (inotifyFd >= 0) {
+                close(inotifyFd);
+                inotifyFd = -1;
+        }
+}
+
+/**
+ * @return How long run() can wait for something to happen before it has something to do.
+ */
+int LibraryWatcher::timeout() const
+{
+        if (firstChange < 0 && polled.isEmpty()) {
+                return -1;
+        }
+
+        qint64 due = std::numeric_limits<qint64>::max();
+        if (firstChange >= 0) {
+                due = qMin(lastChange + quietPeriod, firstChange + maxLatency);
+        }
+        if (!polled.isEmpty()) {
+                due = qMin(due, lastPoll + pollInterval);
+        }
+
+        return static_cast<int>(qBound<qint64>(0, due - clock.elapsed(), pollInterval));
+}
+
+void LibraryWatcher::addRoot(const QByteArray &root)
+{
+        for (const QByteArray &watched : roots) {
+                if (root == watched || root.startsWith(watched + '/')) {
+                        return;
+                }
+        }
+        roots.append(root);
+
+        QElapsedTimer timer;
+        timer.start();
+
+        if (inotifyFd >= 0 && watchTree(root, false)) {
+                qDebug() << "Watching" << watches.size() << "directories under" << root << "in" << timer.elapsed() << "ms";
+                return;
+        }
+
+        unwatchTree(root);
+        polled.insert(root, snapshot(root));
+        lastPoll = clock.elapsed();
+        qDebug() << "Polling" << polled.value(root).size() << "files under" << root << "every"
+                 << pollInterval / 1000 << "seconds";
+}
+
+/**
+ * Watch a directory and every directory under it.
+ *
+ * @param report Whether the files already in the directories count as changed, which they
+ *               do when the directory has just appeared (e.g. it was moved in).
+ * @return False if there weren't enough watches left for every directory.
+ */
+bool LibraryWatcher::watchTree(const QByteArray &path, bool report)
+{
+#ifdef __linux__
+        return walk(path, [this](const QByteArray &directory) {
+                const int watch = inotify_add_watch(inotifyFd, directory.constData(), watchMask);
+                if (watch < 0) {
+                        // Directories we can't read don't matter, running out of watches does.
+                        return errno != ENOSPC;
+                }
+                watches.insert(watch, directory);
+                return true;
+        }, [this, report](const QByteArray &file, int, const char *name) {
+                if (report && isSupported(name)) {
+                        changed(file);
+                }
+        });
+#else
+        (void) path;
+        (void) report;
+        return false;
+#endif
+}
+
+/**
+ * Stop watching a directory and every directory under it, e.g. because it's been moved.
+ */
+void LibraryWatcher::unwatchTree(const QByteArray &path)
+{
+        const QByteArray prefix = path + '/';
+        for (auto watch = watches.begin(); watch != watches.end();) {
+                if (*watch == path || watch->startsWith(prefix)) {
+#ifdef __linux__
+                        inotify_rm_watch(inotifyFd, watch.key());
+#endif
+                        watch = watches.erase(watch);
+                } else {
+                        ++watch;
+                }
+        }
+}
+
+void LibraryWatcher::readEvents()
+{
+#ifdef __linux__
+        alignas(struct inotify_event) char buffer[1 << 14];
+
+        ssize_t length;
+        while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+                for (char *next = buffer; next < buffer + length;) {
+                        const auto *event = reinterpret_cast<const struct inotify_event *>(next);
+                        next += sizeof(struct inotify_event) + event->len;
+
+                        if (event->mask & IN_Q_OVERFLOW) {
+                                // Changes were lost, so only scanning everything again will do.
+                                for (const QByteArray &root : roots) {
+                                        if (!polled.contains(root)) {
+                                                rescan.append(QFile::decodeName(root));
+                                        }
+                                }
+                                rescan.removeDuplicates();
+                                changed(QByteArray());
+                                continue;
+                        }
+                        if (event->mask & IN_IGNORED) {
+                                watches.remove(event->wd);
+                                continue;
+                        }
+
+                        const auto directory = watches.constFind(event->wd);
+                        if (directory == watches.constEnd() || event->len == 0) {
+                                continue;
+                        }
+                        const QByteArray path = *directory + '/' + event->name;
+
+                        if (event->mask & IN_ISDIR) {
+                                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                                        // Files can be added before the watch is, so whatever's
+                                        // already there is passed on.
+                                        if (!watchTree(path, true)) {
+                                                qDebug() << "Ran out of inotify watches under" << path;
+                                        }
+                                } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                                        unwatchTree(path);
+                                        removedDirectories.append(QFile::decodeName(path));
+                                        changed(QByteArray());
+                                }
+                        } else if (!(event->mask & IN_CREATE) && isSupported(event->name)) {
+                                // Files being created are passed on once they're closed.
+                                changed(path);
+                        }
+                }
+        }
+#endif
+}
+
+/**
+ * @return The size and modification time of every file under a directory.
+ */
+LibraryWatcher::Snapshot LibraryWatcher::snapshot(const QByteArray &root) const
+{
+        Snapshot files;
+        walk(root, [](const QByteArray &) {
+                return true;
+        }, [this, &files](const QByteArray &file, int directory, const char *name) {
+                struct stat status;
+                if (isSupported(name) && fstatat(directory, name, &status, 0) == 0 && S_ISREG(status.st_mode)) {
+                        files.insert(file, {static_cast<qint64>(status.st_size),
+                                            static_cast<qint64>(status.st_mtime)});
+                }
+        });
+
+        return files;
+}
+
+/**
+ * Walk the roots that can't be watched again, and compare them against the last walk.
+ */
+void LibraryWatcher::pollRoots()
+{
+        for (auto root = polled.begin(); root != polled.end(); ++root) {
+                const Snapshot now = snapshot(root.key());
+                const Snapshot &before = *root;
+
+                for (auto file = now.constBegin(); file != now.constEnd(); ++file) {
+                        const auto old = before.constFind(file.key());
+                        if (old == before.constEnd() || old->size != file->size || old->modified != file->modified) {
+                                changed(file.key());
+                        }
+                }
+                for (auto file = before.constBegin(); file != before.constEnd(); ++file) {
+                        if (!now.contains(file.key())) {
+                                changed(file.key());
+                        }
+                }
+
+                *root = now;
+        }
+
+        lastPoll = clock.elapsed();
+}
+
+/**
+ * Note that a file has changed, which puts off reading the changes until things have been
+ * quiet for a moment.
+ *
+ * @param path The file, or nothing if it's not a file that changed (e.g. a directory was
+ *             removed).
+ */
+void LibraryWatcher::changed(const QByteArray &path)
+{
+        if (!path.isEmpty()) {
+                pending.insert(path);
+        }
+
+        lastChange = clock.elapsed();
+        if (firstChange < 0) {
+                firstChange = lastChange;
+        }
+}
+
+/**
+ * Read the files that have changed, and pass them on.
+ *
+ * Whether a file was added, changed, or removed is decided by looking at it now, rather
+ * than going by the events, as a burst of events for the same file (e.g. it being written
+ * to a temporary name and moved over the old one) only matters for how it ended up.
+ */
+void LibraryWatcher::flush()
+{
+        LibraryDelta delta;
+        delta.removedDirectories.swap(removedDirectories);
+        delta.rescan.swap(rescan);
+
+        const Song::Properties wanted(properties.load());
+        for (const QByteArray &path : pending) {
+                const QString filePath = QFile::decodeName(path);
+
+                struct stat status;
+                if (stat(path.constData(), &status) == 0 && S_ISREG(status.st_mode)) {
+                        // Read rather than mapped, as whatever changed the file may still be
+                        // rewriting it.
+                        const auto stream = PrefetchedStream::prefetch(path);
+                        delta.songs.append(Song(QFileInfo(filePath), *stream, wanted, TagLib::AudioProperties::Average));
+                } else {
+                        delta.removed.append(filePath);
+                }
+        }
+
+        pending.clear();
+        firstChange = -1;
+        lastChange = -1;
+
+        if (!delta.isEmpty()) {
+                if (Astoria::benchmarking()) {
+                        qDebug() << "Library changed:" << delta.songs.size() << "files added or changed,"
+                                 << delta.removed.size() << "removed," << delta.removedDirectories.size()
+                                 << "directories removed";
+                }
+                emit libraryChanged(delta);
+        }
+}
+
+bool LibraryWatcher::isSupported(const char *name) const
+{
+        const char *extension = strrchr(name, '.');
+        if (extension == nullptr) {
+                return false;
+        }
+
+        return suffixes.contains(QByteArray(extension + 1).toLower());
+}
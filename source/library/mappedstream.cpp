@@ -0,0 +1,143 @@
+#include "includes/library/mappedstream.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// How much of each end of a file the kernel is asked to read ahead, which is enough for
+// the headers and the usual tags, though not always for cover art.
+static constexpr long tagWindow = 64 * 1024;
+
+/**
+ * @param file The file to map. The stream isn't open if it can't be.
+ */
+MappedStream::MappedStream(TagLib::FileName file)
+        : path(file),
+          opened(false),
+          data(nullptr),
+          size(0),
+          position(0),
+          count(0)
+{
+        const int descriptor = ::open(path.constData(), O_RDONLY | O_CLOEXEC);
+        if (descriptor < 0) {
+                return;
+        }
+
+        struct stat status;
+        if (fstat(descriptor, &status) == 0 && S_ISREG(status.st_mode)) {
+                size = static_cast<long>(status.st_size);
+                opened = true;
+        }
+
+        if (opened && size > 0) {
+                void *mapping = mmap(nullptr, static_cast<size_t>(size), PROT_READ, MAP_PRIVATE,
+                                     descriptor, 0);
+                if (mapping == MAP_FAILED) {
+                        opened = false;
+                        size = 0;
+                } else {
+                        data = static_cast<const char *>(mapping);
+
+                        madvise(mapping, static_cast<size_t>(size), MADV_RANDOM);
+                        madvise(mapping, static_cast<size_t>(qMin(size, tagWindow)), MADV_WILLNEED);
+                        if (size > tagWindow) {
+                                // madvise() wants a page aligned address.
+                                const long pageSize = sysconf(_SC_PAGESIZE);
+                                const long tail = (size - tagWindow) / pageSize * pageSize;
+                                madvise(const_cast<char *>(data) + tail,
+                                        static_cast<size_t>(size - tail), MADV_WILLNEED);
+                        }
+                }
+        }
+
+        // The mapping keeps the file open for as long as it's needed.
+        close(descriptor);
+}
+
+MappedStream::~MappedStream()
+{
+        if (data) {
+                munmap(const_cast<char *>(data), static_cast<size_t>(size));
+        }
+}
+
+TagLib::FileName MappedStream::name() const
+{
+        return path.constData();
+}
+
+TagLib::ByteVector MappedStream::readBlock(unsigned long length)
+{
+        if (position >= size || length == 0) {
+                return TagLib::ByteVector();
+        }
+
+        const long available = size - position;
+        const long read = length < static_cast<unsigned long>(available) ? static_cast<long>(length)
+                                                                          : available;
+
+        const TagLib::ByteVector block(data + position, static_cast<unsigned int>(read));
+        position += read;
+        count += read;
+        return block;
+}
+
+void MappedStream::writeBlock(const TagLib::ByteVector &)
+{
+
+}
+
+void MappedStream::insert(const TagLib::ByteVector &, unsigned long, unsigned long)
+{
+
+}
+
+void MappedStream::removeBlock(unsigned long, unsigned long)
+{
+
+}
+
+void MappedStream::truncate(long)
+{
+
+}
+
+bool MappedStream::readOnly() const
+{
+        return true;
+}
+
+bool MappedStream::isOpen() const
+{
+        return opened;
+}
+
+/**
+ * Like fseek(), seeking before the start of the file fails, leaving the position where it
+ * was, but seeking past the end is fine (there's just nothing there to read).
+ */
+void MappedStream::seek(long offset, Position p)
+{
+        long from = 0;
+        if (p == Current) {
+                from = position;
+        } else if (p == End) {
+                from = size;
+        }
+
+        if (from + offset >= 0) {
+                position = from + offset;
+        }
+}
+
+long MappedStream::tell() const
+{
+        return position;
+}
+
+long MappedStream::length()
+{
+        return size;
+}
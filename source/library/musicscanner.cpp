@@ -1,19 +1,897 @@
 #include "includes/library/musicscanner.hpp"
 
-MusicScanner::MusicScanner(QFileInfoList &musicFiles)
-        : files(musicFiles)
+#include <QElapsedTimer>
+#include <QFile>
+#include <QDebug>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/resource.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <sys/ioctl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#endif
+
+#include "includes/library/workstealingpool.hpp"
+#include "includes/library/librarycache.hpp"
+#include "includes/library/prefetchedstream.hpp"
+#include "includes/library/mappedstream.hpp"
+#include "includes/astoria.hpp"
+
+// How many files a single task reads the tags of. Small enough that a directory full
+// of songs is spread over the pool, large enough that queueing isn't the bottleneck.
+static constexpr int filesPerTask = 32;
+
+// How often the number of threads reading at once is tuned, when it isn't already being
+// looked at for batching, in milliseconds.
+static constexpr int tuneInterval = 500;
+
+// How much lower the CPU priority of the scan is while it's in the background.
+static constexpr int backgroundNice = 10;
+
+// How many of the files read are read again when benchmarking.
+static constexpr int benchmarkFiles = 2000;
+
+/**
+ * Set the I/O and CPU priority of the calling thread, if it isn't set already.
+ *
+ * Raising the CPU priority back up needs CAP_SYS_NICE, so without it a thread stays at
+ * the lower priority, but the I/O priority can always go back.
+ */
+static void setThreadPriority(bool background)
+{
+        thread_local int applied = -1;
+        if (applied == static_cast<int>(background)) {
+                return;
+        }
+        applied = static_cast<int>(background);
+
+#ifdef __linux__
+        // glibc doesn't wrap ioprio_set(), so these are from linux/ioprio.h. The "none"
+        // class goes back to an I/O priority based on the CPU priority.
+        constexpr int whoProcess = 1;
+        constexpr int classShift = 13;
+        constexpr int idleClass = 3;
+        syscall(SYS_ioprio_set, whoProcess, 0, background ? idleClass << classShift : 0);
+
+        // On Linux, this only changes the calling thread.
+        setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), background ? backgroundNice : 0);
+#endif
+}
+
+/**
+ * @return How many read system calls the process has made, or -1 if the system won't say.
+ */
+static qint64 readSyscalls()
+{
+        QFile io("/proc/self/io");
+        if (!io.open(QIODevice::ReadOnly)) {
+                return -1;
+        }
+
+        for (const QByteArray &line : io.readAll().split('\n')) {
+                if (line.startsWith("syscr:")) {
+                        return line.mid(6).trimmed().toLongLong();
+                }
+        }
+
+        return -1;
+}
+
+/**
+ * Find where a file starts on its disk.
+ *
+ * @param offset Set to the physical offset of the file's first extent, or 0 if it has no
+ *               extents or can't be opened.
+ * @return Whether the file system can say where files are.
+ */
+static bool physicalOffset(const QByteArray &path, quint64 &offset)
+{
+        offset = 0;
+#ifdef __linux__
+        const int descriptor = open(path.constData(), O_RDONLY | O_CLOEXEC);
+        if (descriptor < 0) {
+                return true;
+        }
+
+        // Room for the request, and the one extent we want back.
+        alignas(fiemap) char request[sizeof(fiemap) + sizeof(fiemap_extent)] = {};
+        fiemap *map = reinterpret_cast<fiemap *>(request);
+        map->fm_start = 0;
+        map->fm_length = FIEMAP_MAX_OFFSET;
+        map->fm_extent_count = 1;
+
+        const bool supported = ioctl(descriptor, FS_IOC_FIEMAP, map) == 0;
+        if (supported && map->fm_mapped_extents > 0) {
+                offset = map->fm_extents[0].fe_physical;
+        }
+
+        close(descriptor);
+        return supported;
+#else
+        Q_UNUSED(path);
+        return false;
+#endif
+}
+
+/**
+ * @return How far a disk's heads would travel reading files at these offsets in order, in
+ *         bytes.
+ */
+static quint64 seekDistance(const std::vector<quint64> &offsets)
+{
+        quint64 distance = 0;
+        for (std::size_t i = 1; i < offsets.size(); ++i) {
+                distance += offsets[i] > offsets[i - 1] ? offsets[i] - offsets[i - 1]
+                                                        : offsets[i - 1] - offsets[i];
+        }
+
+        return distance;
+}
+
+/**
+ * Drop a file from the page cache, so that reading it has to go to the disk.
+ */
+static void evict(const QByteArray &path)
+{
+        const int descriptor = open(path.constData(), O_RDONLY | O_CLOEXEC);
+        if (descriptor >= 0) {
+                posix_fadvise(descriptor, 0, 0, POSIX_FADV_DONTNEED);
+                close(descriptor);
+        }
+}
+
+/**
+ * Read the tags of some files with TagLib::FileStream, then again with MappedStream and
+ * PrefetchedStream, on a single thread, and log how many system calls and how long each
+ * took. The files have just been scanned, so they're in the page cache every time.
+ */
+static void compareStreams(const QStringList &paths, TagLib::AudioProperties::ReadStyle style)
+{
+        enum Stream { File, Mapped, Prefetched };
+        auto measure = [&paths, style](const char *stream, Stream kind) {
+                QElapsedTimer timer;
+                timer.start();
+                const qint64 syscalls = readSyscalls();
+
+                if (kind == Prefetched) {
+                        for (int first = 0; first < paths.size(); first += filesPerTask) {
+                                QList<QByteArray> batch;
+                                for (const QString &path : paths.mid(first, filesPerTask)) {
+                                        batch.append(QFile::encodeName(path));
+                                }
+                                for (const auto &prefetched : PrefetchedStream::prefetch(batch)) {
+                                        TagLib::FileRef file(prefetched.get(), true, style);
+                                }
+                        }
+                } else {
+                        for (const QString &path : paths) {
+                                const QByteArray fileName = QFile::encodeName(path);
+                                if (kind == Mapped) {
+                                        MappedStream mappedStream(fileName.constData());
+                                        TagLib::FileRef file(&mappedStream, true, style);
+                                } else {
+                                        TagLib::FileRef file(fileName.constData(), true, style);
+                                }
+                        }
+                }
+
+                const qint64 elapsed = timer.elapsed();
+                QDebug log = qDebug();
+                log << stream << "read" << paths.size() << "files in" << elapsed << "ms"
+                    << "(" << (elapsed > 0 ? paths.size() * 1000 / elapsed : paths.size()) << "files/s";
+                if (syscalls >= 0) {
+                        log << "," << (readSyscalls() - syscalls) / paths.size() << "read system calls per file";
+                }
+                log << ")";
+        };
+
+        measure("FileStream", File);
+        measure("MappedStream", Mapped);
+        measure("PrefetchedStream", Prefetched);
+}
+
+/**
+ * @param directory The directory to recursively look for songs in.
+ * @param nameFilters The file patterns (e.g. "*.mp3") that we consider to be songs.
+ * @param threads How many threads to read the directory tree with.
+ */
+MusicScanner::MusicScanner(const QString &directory, const QStringList &nameFilters, int threads)
+        : root(directory),
+          threadCount(threads > 0 ? threads : 1),
+          batchSize(0),
+          batchInterval(0),
+          songsCached(0),
+          rescanning(false),
+          songsUnchanged(0),
+          properties(),
+          readStyle(TagLib::AudioProperties::Average),
+          order(DirectoryOrder),
+          active(0),
+          concurrency(threadCount),
+          step(-1),
+          lastThroughput(0),
+          paused(false),
+          background(false),
+          cancelled(false),
+          pool(nullptr),
+          songsScanned(0),
+          directoriesScanned(0),
+          songsRead(0),
+          bytesRead(0),
+          bytesMissed(0)
+{
+        for (const auto &filter : nameFilters) {
+                suffixes.insert(filter.mid(filter.lastIndexOf('.') + 1).toLower().toUtf8());
+        }
+}
+
+/**
+ * Stream the songs found out while the scan is running, instead of all at once at the
+ * end. A batch is passed on once it holds the given number of songs, or once the given
+ * amount of time has passed since the last one, whichever comes first.
+ *
+ * @param size The most songs to hold on to before passing them on, or 0 for no limit.
+ * @param milliseconds The longest to hold on to songs for, or 0 for no limit.
+ */
+void MusicScanner::setBatching(int size, int milliseconds)
+{
+        batchSize = size > 0 ? size : 0;
+        batchInterval = milliseconds > 0 ? milliseconds : 0;
+}
+
+/**
+ * @param t_cache The cache to take songs from when their files haven't changed.
+ */
+void MusicScanner::setCache(QSharedPointer<const LibraryCache> t_cache)
 {
+        cache = t_cache;
+}
+
+/**
+ * @param t_properties The metadata to read on top of the basic tags.
+ */
+void MusicScanner::setProperties(Song::Properties t_properties)
+{
+        properties = t_properties;
+}
+
+/**
+ * @param style How much of each file to read for its duration. Anything but
+ *              TagLib::AudioProperties::Fast reads as much as it takes to get it right.
+ */
+void MusicScanner::setReadStyle(TagLib::AudioProperties::ReadStyle style)
+{
+        readStyle = style;
+}
 
+/**
+ * @param t_order The order to read files in. Anything but DirectoryOrder waits until the
+ *                whole tree has been walked before reading any files.
+ */
+void MusicScanner::setOrder(Order t_order)
+{
+        order = t_order;
+}
+
+/**
+ * Rescan rather than scan, comparing what's found against the files that are already in
+ * the library (see deltaFound()). Files are matched by path, or for files reached through
+ * a symbolic link, by canonical path.
+ *
+ * @param files The files under the directory being scanned that are already in the
+ *              library, by canonical path.
+ */
+void MusicScanner::setKnownFiles(const QHash<QByteArray, KnownFile> &files)
+{
+        rescanning = true;
+        knownIndex.clear();
+        knownIndex.reserve(files.size());
+        knownFiles.clear();
+        knownFiles.reserve(files.size());
+        for (auto file = files.constBegin(); file != files.constEnd(); ++file) {
+                knownIndex.insert(file.key(), knownFiles.size());
+                knownFiles.append(file.value());
+        }
+        knownFound = std::vector<std::atomic<char>>(static_cast<std::size_t>(knownFiles.size()));
+}
+
+/**
+ * Whether a path is on a spinning disk, where reading files in the order they're laid out
+ * on the disk saves a lot of seeking. Only Linux can tell us, everything else is assumed
+ * not to be.
+ */
+bool MusicScanner::isRotational(const QString &path)
+{
+#ifdef __linux__
+        struct stat status;
+        if (stat(QFile::encodeName(path).constData(), &status) != 0) {
+                return false;
+        }
+
+        // Partitions don't have a queue of their own, the disk they're on does.
+        const QString device = QString("/sys/dev/block/%1:%2").arg(major(status.st_dev))
+                                                             .arg(minor(status.st_dev));
+        for (const QString &queue : {device + "/queue/rotational", device + "/../queue/rotational"}) {
+                QFile rotational(queue);
+                if (rotational.open(QIODevice::ReadOnly)) {
+                        return rotational.readAll().trimmed() == "1";
+                }
+        }
+#else
+        Q_UNUSED(path);
+#endif
+        return false;
+}
+
+/**
+ * Stop reading until resume() is called. Whatever's being read already is finished first.
+ */
+void MusicScanner::pause()
+{
+        std::lock_guard<std::mutex> lock(gateMutex);
+        paused = true;
+}
+
+void MusicScanner::resume()
+{
+        {
+                std::lock_guard<std::mutex> lock(gateMutex);
+                paused = false;
+        }
+        gateChanged.notify_all();
+}
+
+/**
+ * Stop the scan as soon as possible. Songs found so far are still passed on.
+ */
+void MusicScanner::cancel()
+{
+        cancelled = true;
+        {
+                // Taking the lock makes sure nothing is between checking and waiting.
+                std::lock_guard<std::mutex> lock(gateMutex);
+        }
+        gateChanged.notify_all();
+}
+
+/**
+ * @param t_background Whether the scan should keep out of the way, reading on a single
+ *                     thread at a lower priority.
+ */
+void MusicScanner::setBackground(bool t_background)
+{
+        {
+                std::lock_guard<std::mutex> lock(gateMutex);
+                background = t_background;
+        }
+        gateChanged.notify_all();
 }
 
 void MusicScanner::run()
 {
-        QList<Song> songs;
         qRegisterMetaType<QList<Song>>("QList<Song>");
-        for (auto &file : files) {
-                // TODO: Think about whether to emit for each song, or at the end
-                songs.append(Song(file));
+        qRegisterMetaType<LibraryDelta>("LibraryDelta");
+
+        QElapsedTimer timer;
+        timer.start();
+
+        songsScanned = 0;
+        songsCached = 0;
+        songsUnchanged = 0;
+        directoriesScanned = 0;
+        songsRead = 0;
+        bytesRead = 0;
+        bytesMissed = 0;
+        estimatedPaths.clear();
+        benchmarkPaths.clear();
+
+        WorkStealingPool workers(threadCount);
+        pool = &workers;
+
+        const QByteArray rootPath = QFile::encodeName(root);
+        workers.submit([this, rootPath](int worker) {
+                scanDirectory(rootPath, worker);
+        });
+        waitFor(workers);
+
+        if (order != DirectoryOrder && !cancelled) {
+                schedule();
+
+                // Each worker takes the next batch of files in order, so that the disk is
+                // read from one end to the other, give or take a batch per worker.
+                std::atomic<int> next(0);
+                const int count = static_cast<int>(scheduled.size());
+                for (int worker = 0; worker < threadCount; ++worker) {
+                        workers.submit(worker, [this, &next, count](int) {
+                                for (int first = next.fetch_add(filesPerTask); first < count;
+                                     first = next.fetch_add(filesPerTask)) {
+                                        QList<QByteArray> files;
+                                        for (int i = first; i < qMin(first + filesPerTask, count); ++i) {
+                                                files.append(scheduled[static_cast<std::size_t>(i)].path);
+                                        }
+                                        scanFiles(files);
+                                }
+                        });
+                }
+                waitFor(workers);
+
+                scheduled.clear();
+                scheduled.shrink_to_fit();
+        }
+        pool = nullptr;
+
+        if (rescanning) {
+                flushDelta();
+        } else {
+                flush();
+        }
+
+        const int songs = songsScanned;
+        const qint64 elapsed = timer.elapsed();
+        qDebug() << "Scanned" << songs << "songs in" << directoriesScanned.load()
+                 << "directories using" << threadCount << "threads in" << elapsed << "ms"
+                 << "(" << (elapsed > 0 ? songs * 1000 / elapsed : songs) << "songs/s,"
+                 << songsCached.load() << "taken from the cache," << songsUnchanged.load()
+                 << "unchanged )"
+                 << (cancelled ? "before being cancelled" : "");
+
+        const int read = songsRead;
+        if (read > 0) {
+                qDebug() << "Read" << read << "files"
+                         << (readStyle == TagLib::AudioProperties::Fast ? "(headers only)" : "")
+                         << "with" << PrefetchedStream::engine() << "at" << bytesRead / read
+                         << "bytes per file," << bytesMissed / read << "of them not read ahead";
+        }
+
+        if (Astoria::benchmarking() && !benchmarkPaths.isEmpty()) {
+                compareStreams(benchmarkPaths, readStyle);
+        }
+
+        if (!estimatedPaths.isEmpty()) {
+                emit durationsEstimated(estimatedPaths);
+        }
+
+        emit scanFinished(songs, elapsed);
+}
+
+/**
+ * Wait for the pool to run out of work, passing on what's found in the meantime when
+ * batching by time.
+ */
+void MusicScanner::waitFor(WorkStealingPool &workers)
+{
+        QElapsedTimer timer;
+        timer.start();
+        int done = songsScanned + songsUnchanged + directoriesScanned;
+
+        while (!workers.waitFor(batchInterval > 0 ? batchInterval : tuneInterval)) {
+                if (batchInterval > 0 && !rescanning) {
+                        flush();
+                }
+
+                const int now = songsScanned + songsUnchanged + directoriesScanned;
+                tune((now - done) * 1000.0 / qMax<qint64>(timer.restart(), 1));
+                done = now;
+        }
+}
+
+/**
+ * Wait until there's room for another task to read, and take it.
+ *
+ * @return Whether the task should go ahead, which it shouldn't if the scan was cancelled.
+ */
+bool MusicScanner::enter()
+{
+        bool inBackground;
+        {
+                std::unique_lock<std::mutex> lock(gateMutex);
+                gateChanged.wait(lock, [this] {
+                        return cancelled || (!paused && active < (background ? 1 : concurrency));
+                });
+                if (cancelled) {
+                        return false;
+                }
+
+                ++active;
+                inBackground = background;
+        }
+
+        setThreadPriority(inBackground);
+        return true;
+}
+
+void MusicScanner::leave()
+{
+        {
+                std::lock_guard<std::mutex> lock(gateMutex);
+                --active;
+        }
+        gateChanged.notify_one();
+}
+
+/**
+ * Hill climb towards the number of threads that finds songs the quickest. The number keeps
+ * moving the same way for as long as that doesn't make things noticeably slower, and
+ * turns around when it does (or when it can't go any further).
+ *
+ * @param throughput How many songs and directories per second were found since last time.
+ */
+void MusicScanner::tune(double throughput)
+{
+        {
+                std::lock_guard<std::mutex> lock(gateMutex);
+                if (paused || background) {
+                        // Nothing to learn from how quickly a held back scan is going.
+                        lastThroughput = 0;
+                        return;
+                }
+
+                if (throughput < lastThroughput * 0.9
+                    || concurrency + step < 1 || concurrency + step > threadCount) {
+                        step = -step;
+                }
+                concurrency = qBound(1, concurrency + step, threadCount);
+                lastThroughput = throughput;
+        }
+        gateChanged.notify_all();
+}
+
+/**
+ * Sort the files found by where they are on the disk. Files are sorted by inode first,
+ * which is usually close to the order they're laid out in, and is free as readdir() tells
+ * us it. For PhysicalOrder, the files are then asked where they start on the disk (in
+ * inode order, which keeps that cheap too), unless the file system can't say.
+ */
+void MusicScanner::schedule()
+{
+        QElapsedTimer timer;
+        timer.start();
+
+        for (std::size_t i = 0; i < scheduled.size(); ++i) {
+                scheduled[i].found = static_cast<int>(i);
+        }
+
+        auto byPosition = [](const ScheduledFile &a, const ScheduledFile &b) {
+                return a.position < b.position;
+        };
+        std::sort(scheduled.begin(), scheduled.end(), byPosition);
+
+        const char *sortedBy = "inode";
+        std::vector<quint64> offsets(scheduled.size());
+        bool located = order == PhysicalOrder && !scheduled.empty();
+        for (std::size_t i = 0; i < scheduled.size() && located; ++i) {
+                located = physicalOffset(scheduled[i].path, offsets[i]);
+        }
+
+        if (located) {
+                sortedBy = "physical offset";
+
+                if (Astoria::benchmarking()) {
+                        std::vector<quint64> inDirectoryOrder(scheduled.size());
+                        for (std::size_t i = 0; i < scheduled.size(); ++i) {
+                                inDirectoryOrder[static_cast<std::size_t>(scheduled[i].found)] = offsets[i];
+                        }
+                        std::vector<quint64> inPhysicalOrder = offsets;
+                        std::sort(inPhysicalOrder.begin(), inPhysicalOrder.end());
+
+                        const quint64 mebibyte = 1 << 20;
+                        qDebug() << "Seeking between files would cover"
+                                 << seekDistance(inDirectoryOrder) / mebibyte << "MiB in directory order,"
+                                 << seekDistance(offsets) / mebibyte << "MiB in inode order, and"
+                                 << seekDistance(inPhysicalOrder) / mebibyte << "MiB in physical order";
+                }
+
+                for (std::size_t i = 0; i < scheduled.size(); ++i) {
+                        scheduled[i].position = offsets[i];
+                }
+                std::stable_sort(scheduled.begin(), scheduled.end(), byPosition);
+        }
+
+        if (Astoria::benchmarking()) {
+                qDebug() << "Scheduled" << scheduled.size() << "files by" << sortedBy << "in" << timer.elapsed()
+                         << "ms";
+        }
+}
+
+/**
+ * Read the entries of a single directory. Sub-directories are pushed back on to the pool
+ * as their own tasks, and songs are read in batches of filesPerTask.
+ *
+ * readdir() tells us the type of most entries already, so we only stat() an entry when
+ * the file system doesn't fill in d_type, or when it's a symbolic link.
+ */
+void MusicScanner::scanDirectory(const QByteArray &path, int worker)
+{
+        if (!enter()) {
+                return;
+        }
+
+        DIR *directory = opendir(path.constData());
+        if (directory == nullptr) {
+                leave();
+                return;
+        }
+
+        ++directoriesScanned;
+
+        QList<QByteArray> files;
+        std::vector<ScheduledFile> toSchedule;
+        const QByteArray prefix = path.endsWith('/') ? path : path + '/';
+
+        while (dirent *entry = readdir(directory)) {
+                const char *name = entry->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                        continue;
+                }
+
+                bool isDirectory = entry->d_type == DT_DIR;
+                bool isFile = entry->d_type == DT_REG;
+                bool isLink = entry->d_type == DT_LNK;
+
+                quint64 inode = static_cast<quint64>(entry->d_ino);
+
+                struct stat status;
+                if (entry->d_type == DT_UNKNOWN) {
+                        if (fstatat(dirfd(directory), name, &status, AT_SYMLINK_NOFOLLOW) != 0) {
+                                continue;
+                        }
+                        isDirectory = S_ISDIR(status.st_mode);
+                        isFile = S_ISREG(status.st_mode);
+                        isLink = S_ISLNK(status.st_mode);
+                        inode = static_cast<quint64>(status.st_ino);
+                }
+
+                if (isLink) {
+                        // Symbolic links are followed for files, but not for directories,
+                        // as that's an easy way to end up walking in circles.
+                        if (fstatat(dirfd(directory), name, &status, 0) != 0) {
+                                continue;
+                        }
+                        isFile = S_ISREG(status.st_mode);
+                        inode = static_cast<quint64>(status.st_ino);
+                }
+
+                if (isDirectory) {
+                        const QByteArray subDirectory = prefix + name;
+                        pool->submit(worker, [this, subDirectory](int thief) {
+                                scanDirectory(subDirectory, thief);
+                        });
+                } else if (isFile && isSupported(name) && order != DirectoryOrder) {
+                        // Files a rescan isn't going to read don't need scheduling.
+                        if (rescanning && isUnchanged(prefix + name)) {
+                                ++songsUnchanged;
+                        } else {
+                                toSchedule.push_back({prefix + name, inode, 0});
+                        }
+                } else if (isFile && isSupported(name)) {
+                        files.append(prefix + name);
+                        if (files.length() == filesPerTask) {
+                                pool->submit(worker, [this, files](int) {
+                                        scanFiles(files);
+                                });
+                                files.clear();
+                        }
+                }
+        }
+
+        closedir(directory);
+        leave();
+
+        if (!toSchedule.empty()) {
+                std::lock_guard<std::mutex> lock(scheduledMutex);
+                scheduled.insert(scheduled.end(), toSchedule.begin(), toSchedule.end());
+        }
+
+        if (!files.isEmpty()) {
+                scanFiles(files);
+        }
+}
+
+/**
+ * Read the songs in a batch of files, taking any that haven't changed from the cache. The
+ * rest have the ends of their files read all at once (see PrefetchedStream) before their
+ * tags are read.
+ */
+void MusicScanner::scanFiles(const QList<QByteArray> &paths)
+{
+        if (!enter()) {
+                return;
+        }
+
+        QList<Song> songs;
+        QList<QByteArray> unread;
+        for (const auto &path : paths) {
+                if (rescanning) {
+                        if (isUnchanged(path)) {
+                                ++songsUnchanged;
+                        } else {
+                                unread.append(path);
+                        }
+                        continue;
+                }
+
+                const QString filePath = QFile::decodeName(path);
+
+                struct stat status;
+                if (cache && stat(path.constData(), &status) == 0 &&
+                    cache->isUpToDate(filePath, static_cast<qint64>(status.st_size),
+                                      static_cast<qint64>(status.st_mtime))) {
+                        Song song = cache->song(filePath);
+
+                        // The cache may have been saved before some of the properties were
+                        // wanted, in which case just those have to be read.
+                        const Song::Properties missing = properties & ~cache->properties();
+                        if (missing) {
+                                song.updateProperties(missing);
+                        }
+
+                        songs.append(song);
+                        ++songsCached;
+                        continue;
+                }
+
+                unread.append(path);
+        }
+
+        if (Astoria::benchmarking()) {
+                // Benchmarks are of reading from the disk, not from memory.
+                for (const QByteArray &path : unread) {
+                        evict(path);
+                }
+        }
+
+        QStringList estimated;
+        QStringList read;
+        int readCount = 0;
+        qint64 bytes = 0;
+        qint64 missed = 0;
+        for (const auto &stream : PrefetchedStream::prefetch(unread)) {
+                const QString filePath = QFile::decodeName(stream->name());
+                bool durationEstimated;
+                songs.append(Song(QFileInfo(filePath), *stream, properties, readStyle, &durationEstimated));
+                if (durationEstimated) {
+                        estimated.append(filePath);
+                }
+                if (Astoria::benchmarking()) {
+                        read.append(filePath);
+                }
+                ++readCount;
+
+                bytes += stream->bytesRead();
+                missed += stream->bytesMissed();
+        }
+
+        songsRead += readCount;
+        bytesRead += bytes;
+        bytesMissed += missed;
+        if (!estimated.isEmpty() || !read.isEmpty()) {
+                std::lock_guard<std::mutex> lock(foundMutex);
+                estimatedPaths.append(estimated);
+                if (benchmarkPaths.length() < benchmarkFiles) {
+                        benchmarkPaths.append(read.mid(0, benchmarkFiles - benchmarkPaths.length()));
+                }
+        }
+
+        songsFound(songs);
+        leave();
+}
+
+/**
+ * Hand the songs a worker found over to the scanner, passing them on straight away if
+ * that fills up a batch.
+ */
+void MusicScanner::songsFound(QList<Song> &songs)
+{
+        songsScanned += songs.length();
+
+        QList<Song> batch;
+        {
+                std::lock_guard<std::mutex> lock(foundMutex);
+                found.append(songs);
+                // A rescan's songs are all passed on together, in its delta.
+                if (!rescanning && batchSize > 0 && found.length() >= batchSize) {
+                        batch.swap(found);
+                }
+        }
+
+        if (!batch.isEmpty()) {
+                // Signals are safe to emit from any thread, and as the library lives in
+                // the GUI thread this is a queued connection.
+                emit passNewItems(batch);
+        }
+}
+
+/**
+ * Check a file against the files known to be in the library, noting that it's been found.
+ *
+ * @return Whether the file's in the library, and hasn't changed since it was read.
+ */
+bool MusicScanner::isUnchanged(const QByteArray &path)
+{
+        auto known = knownIndex.constFind(path);
+        if (known == knownIndex.constEnd()) {
+                // Either it's new, or it's a symbolic link, which the library knows by
+                // where it points.
+                char *resolved = realpath(path.constData(), nullptr);
+                if (resolved != nullptr) {
+                        known = knownIndex.constFind(QByteArray(resolved));
+                        free(resolved);
+                }
+                if (known == knownIndex.constEnd()) {
+                        return false;
+                }
+        }
+
+        knownFound[static_cast<std::size_t>(*known)].store(1);
+
+        struct stat status;
+        const KnownFile &file = knownFiles[*known];
+        return stat(path.constData(), &status) == 0 &&
+               file.size == static_cast<qint64>(status.st_size) &&
+               file.modified == static_cast<qint64>(status.st_mtime);
+}
+
+/**
+ * Pass on everything a rescan found as one delta: the files that were read because they're
+ * new or have changed, and the known files that weren't found. A cancelled rescan can't
+ * tell which files have gone, so it only passes on what it read.
+ */
+void MusicScanner::flushDelta()
+{
+        LibraryDelta delta;
+        {
+                std::lock_guard<std::mutex> lock(foundMutex);
+                delta.songs.swap(found);
+        }
+
+        if (!cancelled) {
+                for (auto known = knownIndex.constBegin(); known != knownIndex.constEnd(); ++known) {
+                        if (!knownFound[static_cast<std::size_t>(known.value())].load()) {
+                                delta.removed.append(QFile::decodeName(known.key()));
+                        }
+                }
+        }
+
+        if (Astoria::benchmarking()) {
+                qDebug() << "Rescan found" << delta.songs.size() << "new or changed songs, and"
+                         << delta.removed.size() << "songs that have gone";
+        }
+
+        emit deltaFound(delta);
+}
+
+void MusicScanner::flush()
+{
+        QList<Song> batch;
+        {
+                std::lock_guard<std::mutex> lock(foundMutex);
+                batch.swap(found);
+        }
+
+        if (!batch.isEmpty()) {
+                emit passNewItems(batch);
+        }
+}
+
+bool MusicScanner::isSupported(const char *name) const
+{
+        const char *extension = strrchr(name, '.');
+        if (extension == nullptr) {
+                return false;
         }
 
-        emit passNewItems(songs);
+        return suffixes.contains(QByteArray(extension + 1).toLower());
 }
@@ -1,17 +1,503 @@
 #include "includes/library/playlist.hpp"
 
-Playlist::Playlist()
-        : QMediaPlaylist()
+#include <QMediaContent>
+#include <QUrl>
+
+#include <algorithm>
+#include <vector>
+
+Playlist::Playlist(QObject *parent)
+        : QObject(parent),
+          root(nullptr),
+          currentNode(nullptr),
+          priorities(std::random_device()()),
+          player(nullptr)
+{
+
+}
+
+Playlist::~Playlist()
+{
+        release(root);
+}
+
+/**
+ * Have a player play the current entry, and move on to the next entry whenever it finishes
+ * a song.
+ */
+void Playlist::setPlayer(QMediaPlayer *t_player)
+{
+        if (player != nullptr) {
+                disconnect(player, nullptr, this, nullptr);
+        }
+
+        player = t_player;
+        if (player != nullptr) {
+                connect(player, SIGNAL(mediaStatusChanged(QMediaPlayer::MediaStatus)),
+                        this, SLOT(mediaStatusChanged(QMediaPlayer::MediaStatus)));
+        }
+}
+
+/**
+ * @return The file at a position in the queue, or nothing if there isn't one there.
+ */
+QString Playlist::at(int index) const
+{
+        const Node *node = nodeAt(index);
+        return node == nullptr ? QString() : node->path;
+}
+
+/**
+ * @return The file that's playing (or would be, if the player was playing), or nothing.
+ */
+QString Playlist::current() const
+{
+        return currentNode == nullptr ? QString() : currentNode->path;
+}
+
+/**
+ * @return Where the current entry is in the queue, or -1 if there isn't one.
+ */
+int Playlist::currentIndex() const
+{
+        return currentNode == nullptr ? -1 : position(currentNode);
+}
+
+/**
+ * Add some files to the end of the queue.
+ */
+void Playlist::append(const QStringList &paths)
+{
+        insert(size(), paths);
+}
+
+/**
+ * Add some files to the queue. The new entries are built into a tree of their own in one
+ * pass, which is then merged in, so adding a batch costs O(k + log n) rather than
+ * O(k log n).
+ *
+ * @param index Where the first of them goes, which is clamped to the queue.
+ * @param paths The files, as local paths.
+ */
+void Playlist::insert(int index, const QStringList &paths)
+{
+        if (paths.isEmpty()) {
+                return;
+        }
+
+        Node *before;
+        Node *after;
+        split(root, qBound(0, index, size()), before, after);
+        root = merge(merge(before, build(paths)), after);
+}
+
+/**
+ * Add some files to play after the current one, or at the start if nothing's playing.
+ */
+void Playlist::playNext(const QStringList &paths)
+{
+        insert(currentIndex() + 1, paths);
+}
+
+/**
+ * Take some entries out of the queue. If the current entry is one of them, the entry after
+ * them becomes the current one.
+ *
+ * @param first Where the first entry to remove is.
+ * @param count How many entries to remove.
+ */
+void Playlist::remove(int first, int count)
+{
+        first = qBound(0, first, size());
+        count = qBound(0, count, size() - first);
+        if (count == 0) {
+                return;
+        }
+
+        const int playing = currentIndex();
+
+        Node *before;
+        Node *removed;
+        Node *after;
+        split(root, first, before, after);
+        split(after, count, removed, after);
+        root = merge(before, after);
+        release(removed);
+
+        if (playing >= first && playing < first + count) {
+                setCurrent(nodeAt(first));
+        }
+}
+
+/**
+ * Take every entry for some files out of the queue, e.g. because they've been removed from
+ * the library. Entries next to each other are removed together.
+ *
+ * @param paths The files, as local paths.
+ */
+void Playlist::removeFiles(const QSet<QString> &paths)
+{
+        std::vector<int> positions;
+        for (const QString &path : paths) {
+                for (auto entry = entries.constFind(path); entry != entries.constEnd() && entry.key() == path;
+                     ++entry) {
+                        positions.push_back(position(*entry));
+                }
+        }
+        std::sort(positions.begin(), positions.end());
+
+        // From the end, so that the positions before each run don't move.
+        std::size_t last = positions.size();
+        while (last > 0) {
+                std::size_t first = last - 1;
+                while (first > 0 && positions[first - 1] + 1 == positions[first]) {
+                        --first;
+                }
+
+                remove(positions[first], static_cast<int>(last - first));
+                last = first;
+        }
+}
+
+/**
+ * Move some entries somewhere else in the queue. The current entry stays current.
+ *
+ * @param first Where the first entry to move is.
+ * @param count How many entries to move.
+ * @param to Where the first of them should be once they've moved.
+ */
+void Playlist::move(int first, int count, int to)
+{
+        first = qBound(0, first, size());
+        count = qBound(0, count, size() - first);
+        if (count == 0) {
+                return;
+        }
+
+        Node *before;
+        Node *moving;
+        Node *after;
+        split(root, first, before, after);
+        split(after, count, moving, after);
+        root = merge(before, after);
+
+        split(root, qBound(0, to, size()), before, after);
+        root = merge(merge(before, moving), after);
+}
+
+void Playlist::clear()
+{
+        release(root);
+        root = nullptr;
+        setCurrent(nullptr);
+}
+
+/**
+ * Jump to a position in the queue.
+ *
+ * @return Whether there's an entry there.
+ */
+bool Playlist::setCurrentIndex(int index)
+{
+        Node *node = nodeAt(index);
+        if (node == nullptr) {
+                return false;
+        }
+
+        setCurrent(node);
+        return true;
+}
+
+/**
+ * Jump to a file's entry in the queue, without looking through the queue for it.
+ *
+ * A file can be queued more than once (e.g. after "Play next"), in which case the first of
+ * its entries at or after the current one is jumped to, so that the queue carries on from
+ * there. If they're all before the current one, the first of them in the queue is.
+ *
+ * @return Whether the file's in the queue.
+ */
+bool Playlist::jumpTo(const QString &path)
 {
+        const int playing = qMax(currentIndex(), 0);
 
+        Node *ahead = nullptr;
+        Node *behind = nullptr;
+        int aheadIndex = 0;
+        int behindIndex = 0;
+        for (auto entry = entries.constFind(path); entry != entries.constEnd() && entry.key() == path; ++entry) {
+                const int index = position(*entry);
+                if (index >= playing) {
+                        if (ahead == nullptr || index < aheadIndex) {
+                                ahead = *entry;
+                                aheadIndex = index;
+                        }
+                } else if (behind == nullptr || index < behindIndex) {
+                        behind = *entry;
+                        behindIndex = index;
+                }
+        }
+
+        Node *node = ahead != nullptr ? ahead : behind;
+        if (node == nullptr) {
+                return false;
+        }
+
+        setCurrent(node);
+        return true;
+}
+
+/**
+ * @return Whether there was a next entry to go to.
+ */
+bool Playlist::next()
+{
+        Node *node = currentNode == nullptr ? nullptr : successor(currentNode);
+        if (node == nullptr) {
+                return false;
+        }
+
+        setCurrent(node);
+        return true;
+}
+
+/**
+ * @return Whether there was a previous entry to go to.
+ */
+bool Playlist::previous()
+{
+        Node *node = currentNode == nullptr ? nullptr : predecessor(currentNode);
+        if (node == nullptr) {
+                return false;
+        }
+
+        setCurrent(node);
+        return true;
+}
+
+void Playlist::mediaStatusChanged(QMediaPlayer::MediaStatus status)
+{
+        if (status == QMediaPlayer::EndOfMedia && next()) {
+                player->play();
+        }
+}
+
+/**
+ * Make an entry the current one, and have the player play it if it was playing.
+ */
+void Playlist::setCurrent(Node *node)
+{
+        currentNode = node;
+        if (player == nullptr) {
+                return;
+        }
+
+        const bool playing = player->state() == QMediaPlayer::PlayingState;
+        player->setMedia(node == nullptr ? QMediaContent() : QMediaContent(QUrl::fromLocalFile(node->path)));
+        if (playing && node != nullptr) {
+                player->play();
+        }
+}
+
+/**
+ * Work out a node's size from its children's, and make sure they know it's their parent.
+ */
+void Playlist::update(Node *node)
+{
+        node->size = 1 + sizeOf(node->left) + sizeOf(node->right);
+        if (node->left != nullptr) {
+                node->left->parent = node;
+        }
+        if (node->right != nullptr) {
+                node->right->parent = node;
+        }
+}
+
+/**
+ * Join two trees, with every entry of the first before every entry of the second.
+ *
+ * @return The joined tree.
+ */
+Playlist::Node *Playlist::merge(Node *first, Node *second)
+{
+        if (first == nullptr || second == nullptr) {
+                Node *only = first == nullptr ? second : first;
+                if (only != nullptr) {
+                        only->parent = nullptr;
+                }
+                return only;
+        }
+
+        Node *top;
+        if (first->priority > second->priority) {
+                first->right = merge(first->right, second);
+                top = first;
+        } else {
+                second->left = merge(first, second->left);
+                top = second;
+        }
+
+        update(top);
+        top->parent = nullptr;
+        return top;
 }
 
-void Playlist::next()
+/**
+ * Split a tree in two, the first count entries and the rest.
+ */
+void Playlist::split(Node *node, int count, Node *&before, Node *&after)
 {
-        QMediaPlaylist::next();
+        if (node == nullptr) {
+                before = nullptr;
+                after = nullptr;
+                return;
+        }
+
+        if (sizeOf(node->left) >= count) {
+                Node *left;
+                split(node->left, count, before, left);
+                node->left = left;
+                after = node;
+        } else {
+                Node *right;
+                split(node->right, count - sizeOf(node->left) - 1, right, after);
+                node->right = right;
+                before = node;
+        }
+
+        update(node);
+        node->parent = nullptr;
 }
 
-void Playlist::previous()
+/**
+ * @return Where a node is in the queue, found by walking up to the root.
+ */
+int Playlist::position(const Node *node)
 {
-        QMediaPlaylist::previous();
+        int index = sizeOf(node->left);
+        for (; node->parent != nullptr; node = node->parent) {
+                if (node == node->parent->right) {
+                        index += sizeOf(node->parent->left) + 1;
+                }
+        }
+
+        return index;
+}
+
+Playlist::Node *Playlist::successor(Node *node)
+{
+        if (node->right != nullptr) {
+                node = node->right;
+                while (node->left != nullptr) {
+                        node = node->left;
+                }
+                return node;
+        }
+
+        while (node->parent != nullptr && node == node->parent->right) {
+                node = node->parent;
+        }
+        return node->parent;
+}
+
+Playlist::Node *Playlist::predecessor(Node *node)
+{
+        if (node->left != nullptr) {
+                node = node->left;
+                while (node->right != nullptr) {
+                        node = node->right;
+                }
+                return node;
+        }
+
+        while (node->parent != nullptr && node == node->parent->left) {
+                node = node->parent;
+        }
+        return node->parent;
+}
+
+Playlist::Node *Playlist::nodeAt(int index) const
+{
+        if (index < 0 || index >= size()) {
+                return nullptr;
+        }
+
+        Node *node = root;
+        while (true) {
+                const int before = sizeOf(node->left);
+                if (index < before) {
+                        node = node->left;
+                } else if (index == before) {
+                        return node;
+                } else {
+                        index -= before + 1;
+                        node = node->right;
+                }
+        }
+}
+
+/**
+ * Build a tree of new entries in one pass, without comparing any priorities but the ones
+ * on the tree's right edge (a Cartesian tree, built with a stack).
+ */
+Playlist::Node *Playlist::build(const QStringList &paths)
+{
+        std::vector<Node *> rightEdge;
+
+        for (const QString &path : paths) {
+                Node *node = new Node{path, static_cast<quint32>(priorities()), 1, nullptr, nullptr, nullptr};
+                entries.insert(path, node);
+
+                Node *below = nullptr;
+                while (!rightEdge.empty() && rightEdge.back()->priority < node->priority) {
+                        below = rightEdge.back();
+                        rightEdge.pop_back();
+                }
+
+                node->left = below;
+                if (below != nullptr) {
+                        below->parent = node;
+                }
+                if (!rightEdge.empty()) {
+                        rightEdge.back()->right = node;
+                        node->parent = rightEdge.back();
+                }
+                rightEdge.push_back(node);
+        }
+
+        Node *top = rightEdge.empty() ? nullptr : rightEdge.front();
+        resize(top);
+        return top;
+}
+
+/**
+ * Work out the sizes of a whole tree, children before their parents.
+ */
+void Playlist::resize(Node *node)
+{
+        if (node == nullptr) {
+                return;
+        }
+
+        resize(node->left);
+        resize(node->right);
+        node->size = 1 + sizeOf(node->left) + sizeOf(node->right);
+}
+
+/**
+ * Free a tree, and forget its entries.
+ */
+void Playlist::release(Node *node)
+{
+        if (node == nullptr) {
+                return;
+        }
+
+        release(node->left);
+        release(node->right);
+        entries.remove(node->path, node);
+        if (node == currentNode) {
+                currentNode = nullptr;
+        }
+        delete node;
 }
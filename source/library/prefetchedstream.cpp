@@ -0,0 +1,303 @@
+#include "includes/library/prefetchedstream.hpp"
+
+#include <sys/stat.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+// How much of each end of a file is read ahead of time. That's enough for the headers, and
+// the tags of most files, though not always their cover art.
+static constexpr long window = 64 * 1024;
+
+/**
+ * Read from a file until the buffer is full, or there's nothing left to read.
+ *
+ * @return How much was read.
+ */
+static long readAt(int descriptor, char *buffer, long length, long offset)
+{
+        long done = 0;
+        while (done < length) {
+                const ssize_t read = pread(descriptor, buffer + done, static_cast<size_t>(length - done),
+                                           static_cast<off_t>(offset + done));
+                if (read <= 0) {
+                        break;
+                }
+                done += static_cast<long>(read);
+        }
+
+        return done;
+}
+
+PrefetchedStream::PrefetchedStream(const QByteArray &t_path)
+        : path(t_path),
+          descriptor(::open(t_path.constData(), O_RDONLY | O_CLOEXEC)),
+          size(0),
+          position(0),
+          tailStart(0),
+          count(0),
+          missed(0)
+{
+        struct stat status;
+        if (descriptor < 0 || fstat(descriptor, &status) != 0 || !S_ISREG(status.st_mode)) {
+                return;
+        }
+
+        size = static_cast<long>(status.st_size);
+        tailStart = qMax(qMin(size, window), size - window);
+
+        // Filled in by prefetch().
+        head = TagLib::ByteVector(static_cast<unsigned int>(qMin(size, window)), 0);
+        tail = TagLib::ByteVector(static_cast<unsigned int>(size - tailStart), 0);
+}
+
+PrefetchedStream::~PrefetchedStream()
+{
+        if (descriptor >= 0) {
+                close(descriptor);
+        }
+}
+
+/**
+ * Open a batch of files, and read both ends of each of them.
+ *
+ * @param paths The files to read.
+ * @return A stream for each file, in the same order. Files that can't be opened get a
+ *         stream that isn't open.
+ */
+std::vector<std::unique_ptr<PrefetchedStream>> PrefetchedStream::prefetch(const QList<QByteArray> &paths)
+{
+        std::vector<std::unique_ptr<PrefetchedStream>> streams;
+        streams.reserve(static_cast<std::size_t>(paths.size()));
+        for (const QByteArray &path : paths) {
+                streams.emplace_back(new PrefetchedStream(path));
+        }
+
+        readAll(streams);
+        return streams;
+}
+
+/**
+ * Open a single file, and read both ends of it.
+ *
+ * @param path The file to read.
+ * @return A stream for the file, which isn't open if the file can't be.
+ */
+std::unique_ptr<PrefetchedStream> PrefetchedStream::prefetch(const QByteArray &path)
+{
+        return std::move(prefetch(QList<QByteArray>{path}).front());
+}
+
+/**
+ * @return What prefetch() reads files with, for logging.
+ */
+const char *PrefetchedStream::engine()
+{
+#ifdef HAVE_LIBURING
+        return "io_uring";
+#else
+        return "pread";
+#endif
+}
+
+void PrefetchedStream::readAll(std::vector<std::unique_ptr<PrefetchedStream>> &streams)
+{
+#ifdef HAVE_LIBURING
+        // Setting up a ring isn't worth it for a single file.
+        if (streams.size() > 1 && readAllUring(streams)) {
+                return;
+        }
+#endif
+
+        for (auto &stream : streams) {
+                for (TagLib::ByteVector *buffer : {&stream->head, &stream->tail}) {
+                        if (buffer->isEmpty()) {
+                                continue;
+                        }
+
+                        const long offset = buffer == &stream->head ? 0 : stream->tailStart;
+                        const long read = readAt(stream->descriptor, buffer->data(),
+                                                 static_cast<long>(buffer->size()), offset);
+                        buffer->resize(static_cast<unsigned int>(read));
+                }
+        }
+}
+
+#ifdef HAVE_LIBURING
+/**
+ * Submit every read at once, and wait for them all to complete.
+ *
+ * A read that wasn't submitted, or whose completion never came, leaves its buffer empty, so
+ * that readBlock() reads that part of the file itself rather than handing out the zeros the
+ * buffer was filled with.
+ *
+ * @return Whether io_uring could be used. It can be turned off, or missing from older
+ *         kernels, in which case nothing has been read.
+ */
+bool PrefetchedStream::readAllUring(std::vector<std::unique_ptr<PrefetchedStream>> &streams)
+{
+        struct Read
+        {
+                PrefetchedStream *stream;
+                TagLib::ByteVector *buffer;
+                bool done;
+        };
+
+        std::vector<Read> reads;
+        for (auto &stream : streams) {
+                for (TagLib::ByteVector *buffer : {&stream->head, &stream->tail}) {
+                        if (!buffer->isEmpty()) {
+                                reads.push_back(Read{stream.get(), buffer, false});
+                        }
+                }
+        }
+        if (reads.empty()) {
+                return true;
+        }
+
+        io_uring ring;
+        if (io_uring_queue_init(static_cast<unsigned>(reads.size()), &ring, 0) < 0) {
+                return false;
+        }
+
+        for (Read &read : reads) {
+                const long offset = read.buffer == &read.stream->head ? 0 : read.stream->tailStart;
+                io_uring_sqe *entry = io_uring_get_sqe(&ring);
+                io_uring_prep_read(entry, read.stream->descriptor, read.buffer->data(), read.buffer->size(),
+                                   static_cast<__u64>(offset));
+                io_uring_sqe_set_data(entry, &read);
+        }
+
+        const int submitted = io_uring_submit(&ring);
+        if (submitted <= 0) {
+                // Nothing's in flight, so the buffers can be read into the usual way.
+                io_uring_queue_exit(&ring);
+                return false;
+        }
+
+        int completed = 0;
+        while (completed < submitted) {
+                io_uring_cqe *completion = nullptr;
+                const int waited = io_uring_wait_cqe(&ring, &completion);
+                if (waited == -EINTR) {
+                        continue;
+                }
+                if (waited < 0) {
+                        break;
+                }
+
+                // A short or failed read leaves the rest to be read from the file if it's
+                // needed.
+                auto *read = static_cast<Read *>(io_uring_cqe_get_data(completion));
+                read->buffer->resize(static_cast<unsigned int>(qMax(completion->res, 0)));
+                read->done = true;
+                io_uring_cqe_seen(&ring, completion);
+                ++completed;
+        }
+
+        io_uring_queue_exit(&ring);
+
+        for (Read &read : reads) {
+                if (!read.done) {
+                        read.buffer->resize(0);
+                }
+        }
+        return true;
+}
+#endif
+
+TagLib::FileName PrefetchedStream::name() const
+{
+        return path.constData();
+}
+
+TagLib::ByteVector PrefetchedStream::readBlock(unsigned long length)
+{
+        if (position >= size || length == 0) {
+                return TagLib::ByteVector();
+        }
+
+        const long available = size - position;
+        const long wanted = length < static_cast<unsigned long>(available) ? static_cast<long>(length)
+                                                                            : available;
+        const long headSize = static_cast<long>(head.size());
+        const long tailSize = static_cast<long>(tail.size());
+
+        TagLib::ByteVector block;
+        if (position + wanted <= headSize) {
+                block = head.mid(static_cast<unsigned int>(position), static_cast<unsigned int>(wanted));
+        } else if (position >= tailStart && position + wanted <= tailStart + tailSize) {
+                block = tail.mid(static_cast<unsigned int>(position - tailStart),
+                                 static_cast<unsigned int>(wanted));
+        } else {
+                block = TagLib::ByteVector(static_cast<unsigned int>(wanted), 0);
+                block.resize(static_cast<unsigned int>(readAt(descriptor, block.data(), wanted, position)));
+                missed += block.size();
+        }
+
+        position += static_cast<long>(block.size());
+        count += block.size();
+        return block;
+}
+
+void PrefetchedStream::writeBlock(const TagLib::ByteVector &)
+{
+
+}
+
+void PrefetchedStream::insert(const TagLib::ByteVector &, unsigned long, unsigned long)
+{
+
+}
+
+void PrefetchedStream::removeBlock(unsigned long, unsigned long)
+{
+
+}
+
+void PrefetchedStream::truncate(long)
+{
+
+}
+
+bool PrefetchedStream::readOnly() const
+{
+        return true;
+}
+
+bool PrefetchedStream::isOpen() const
+{
+        return descriptor >= 0;
+}
+
+/**
+ * Like fseek(), seeking before the start of the file fails, leaving the position where it
+ * was, but seeking past the end is fine (there's just nothing there to read).
+ */
+void PrefetchedStream::seek(long offset, Position p)
+{
+        long from = 0;
+        if (p == Current) {
+                from = position;
+        } else if (p == End) {
+                from = size;
+        }
+
+        if (from + offset >= 0) {
+                position = from + offset;
+        }
+}
+
+long PrefetchedStream::tell() const
+{
+        return position;
+}
+
+long PrefetchedStream::length()
+{
+        return size;
+}
@@ -0,0 +1,81 @@
+#include "includes/library/propertyloader.hpp"
+
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include "includes/library/workstealingpool.hpp"
+
+// How many files each task reads, and how often what's been read is passed back.
+static constexpr int filesPerTask = 64;
+static constexpr int flushInterval = 250;
+
+/**
+ * @param t_records The records to read the properties for.
+ * @param t_paths The path of each record's file.
+ * @param t_properties The properties to read.
+ * @param threads How many threads to read the files with.
+ */
+PropertyLoader::PropertyLoader(const QVector<int> &t_records, const QStringList &t_paths,
+                               Song::Properties t_properties, int threads)
+        : records(t_records),
+          paths(t_paths),
+          properties(t_properties),
+          threadCount(threads > 0 ? threads : 1),
+          bytesRead(0)
+{
+
+}
+
+void PropertyLoader::run()
+{
+        qRegisterMetaType<QList<Song>>("QList<Song>");
+        qRegisterMetaType<QVector<int>>("QVector<int>");
+
+        QElapsedTimer timer;
+        timer.start();
+
+        WorkStealingPool workers(threadCount);
+        for (int first = 0; first < records.size(); first += filesPerTask) {
+                workers.submit([this, first](int) {
+                        const int last = qMin(first + filesPerTask, records.size());
+
+                        QList<Song> songs;
+                        songs.reserve(last - first);
+                        qint64 bytes = 0;
+                        for (int i = first; i < last && !isInterruptionRequested(); ++i) {
+                                Song song;
+                                song.filePath = paths[i];
+                                song.updateProperties(properties, &bytes);
+                                songs.append(song);
+                        }
+                        bytesRead += bytes;
+
+                        std::lock_guard<std::mutex> lock(loadedMutex);
+                        loadedRecords += records.mid(first, songs.size());
+                        loadedSongs += songs;
+                });
+        }
+
+        while (!workers.waitFor(flushInterval)) {
+                flush();
+        }
+        flush();
+
+        qDebug() << "Read the properties of" << records.size() << "songs in" << timer.elapsed() << "ms"
+                 << "(" << (records.isEmpty() ? 0 : bytesRead / records.size()) << "bytes per file )";
+}
+
+void PropertyLoader::flush()
+{
+        QVector<int> batchRecords;
+        QList<Song> batchSongs;
+        {
+                std::lock_guard<std::mutex> lock(loadedMutex);
+                batchRecords.swap(loadedRecords);
+                batchSongs.swap(loadedSongs);
+        }
+
+        if (!batchRecords.isEmpty()) {
+                emit propertiesLoaded(batchRecords, batchSongs, static_cast<int>(properties));
+        }
+}
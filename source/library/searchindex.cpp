@@ -0,0 +1,522 @@
+#include "includes/library/searchindex.hpp"
+
+#include <QStringList>
+#include <QThread>
+
+#include <algorithm>
+#include <vector>
+
+#include "includes/library/workstealingpool.hpp"
+#include "includes/library/fuzzypattern.hpp"
+
+constexpr quint8 SearchIndex::noMatch;
+
+// Fewer titles than this are fuzzy matched on the calling thread.
+static constexpr int parallelThreshold = 1 << 15;
+
+/**
+ * @return The three characters starting at index, packed into one integer.
+ */
+static quint64 trigram(const QString &text, int index)
+{
+        return static_cast<quint64>(text.at(index).unicode()) << 32
+               | static_cast<quint64>(text.at(index + 1).unicode()) << 16
+               | static_cast<quint64>(text.at(index + 2).unicode());
+}
+
+/**
+ * The trigrams of a normalized string. Each word is padded with two spaces in front and
+ * one behind, so that the start of a word has trigrams of its own, which is what lets
+ * words of fewer than three characters be searched for.
+ *
+ * @return The string's trigrams, sorted, without repeats.
+ */
+static std::vector<quint64> textTrigrams(const QString &normalized)
+{
+        std::vector<quint64> trigrams;
+        for (const QString &word : normalized.split(' ', QString::SkipEmptyParts)) {
+                const QString padded = "  " + word + " ";
+                for (int i = 0; i + 2 < padded.size(); ++i) {
+                        trigrams.push_back(trigram(padded, i));
+                }
+        }
+
+        std::sort(trigrams.begin(), trigrams.end());
+        trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+        return trigrams;
+}
+
+/**
+ * The trigrams to look up for a word being searched for. Words of three characters or more
+ * can be found anywhere in a word, but shorter words only match the start of one.
+ */
+static std::vector<quint64> wordTrigrams(const QString &word)
+{
+        std::vector<quint64> trigrams;
+        if (word.size() < 3) {
+                trigrams.push_back(trigram(QString(3 - word.size(), ' ') + word, 0));
+        } else {
+                for (int i = 0; i + 2 < word.size(); ++i) {
+                        trigrams.push_back(trigram(word, i));
+                }
+        }
+
+        return trigrams;
+}
+
+/**
+ * Words longer than a trigram can have all of their trigrams in a string without being
+ * in it, so anything found for them has to be checked.
+ */
+static bool needsChecking(const QString &word)
+{
+        return word.size() > 3;
+}
+
+/**
+ * Whether a normalized string has a word in it, the way it would be found through the
+ * trigrams (see wordTrigrams()): words shorter than a trigram at the start of one of its
+ * words, and longer ones anywhere in it.
+ */
+static bool containsWord(const QStringRef &text, const QString &word)
+{
+        if (word.size() >= 3) {
+                return text.contains(word);
+        }
+
+        for (int from = text.indexOf(word); from >= 0; from = text.indexOf(word, from + 1)) {
+                if (from == 0 || text.at(from - 1) == ' ') {
+                        return true;
+                }
+        }
+        return false;
+}
+
+static void insertSorted(QVector<int> &ids, int id)
+{
+        if (ids.isEmpty() || ids.last() < id) {
+                // Records are nearly always added in order, so this is the usual case.
+                ids.append(id);
+                return;
+        }
+
+        auto position = std::lower_bound(ids.begin(), ids.end(), id);
+        if (*position != id) {
+                ids.insert(position, id);
+        }
+}
+
+/**
+ * Move the IDs in a sorted list to where they've moved to, dropping any that have gone. As
+ * nothing moves past anything else, the list stays sorted.
+ */
+static void remapSorted(QVector<int> &ids, const QVector<int> &moved)
+{
+        int kept = 0;
+        for (int id : ids) {
+                if (moved[id] >= 0) {
+                        ids[kept++] = moved[id];
+                }
+        }
+        ids.resize(kept);
+}
+
+static void eraseSorted(QVector<int> &ids, int id)
+{
+        auto position = std::lower_bound(ids.begin(), ids.end(), id);
+        if (position != ids.end() && *position == id) {
+                ids.erase(position);
+        }
+}
+
+void SearchIndex::TrigramIndex::insert(int id, const QString &normalized)
+{
+        for (quint64 trigram : textTrigrams(normalized)) {
+                insertSorted(postings[trigram], id);
+        }
+}
+
+void SearchIndex::TrigramIndex::erase(int id, const QString &normalized)
+{
+        for (quint64 trigram : textTrigrams(normalized)) {
+                auto postingList = postings.find(trigram);
+                if (postingList != postings.end()) {
+                        eraseSorted(*postingList, id);
+                }
+        }
+}
+
+void SearchIndex::TrigramIndex::remap(const QVector<int> &moved)
+{
+        for (auto postingList = postings.begin(); postingList != postings.end();) {
+                remapSorted(*postingList, moved);
+                if (postingList->isEmpty()) {
+                        postingList = postings.erase(postingList);
+                } else {
+                        ++postingList;
+                }
+        }
+}
+
+/**
+ * @param word A normalized word.
+ * @return Everything that has all of the word's trigrams, in order of ID.
+ */
+QVector<int> SearchIndex::TrigramIndex::candidates(const QString &word) const
+{
+        std::vector<const QVector<int> *> lists;
+        for (quint64 trigram : wordTrigrams(word)) {
+                auto postingList = postings.constFind(trigram);
+                if (postingList == postings.constEnd()) {
+                        return QVector<int>();
+                }
+                lists.push_back(&*postingList);
+        }
+
+        // Starting from the shortest list keeps every intersection as small as it can be.
+        std::sort(lists.begin(), lists.end(), [](const QVector<int> *a, const QVector<int> *b) {
+                return a->size() < b->size();
+        });
+
+        QVector<int> found = *lists.front();
+        QVector<int> intersection;
+        for (std::size_t i = 1; i < lists.size() && !found.isEmpty(); ++i) {
+                intersection.clear();
+                std::set_intersection(found.cbegin(), found.cend(),
+                                      lists[i]->cbegin(), lists[i]->cend(),
+                                      std::back_inserter(intersection));
+                found.swap(intersection);
+        }
+
+        return found;
+}
+
+SearchIndex::SearchIndex(const LibraryStore &t_library)
+        : library(t_library)
+{
+
+}
+
+SearchIndex::~SearchIndex() = default;
+
+/**
+ * Fold text into the form it's searched in, so that e.g. "Björk" and "bjork" are the same.
+ * Anything that isn't a letter or a number separates words.
+ */
+QString SearchIndex::normalize(const QString &text)
+{
+        const QString decomposed = text.normalized(QString::NormalizationForm_KD);
+
+        QString normalized;
+        normalized.reserve(decomposed.size());
+        for (const QChar character : decomposed) {
+                if (character.isMark()) {
+                        // The accents split off of letters by decomposing them.
+                        continue;
+                }
+                normalized.append(character.isLetterOrNumber() ? character.toCaseFolded() : QChar(' '));
+        }
+
+        return normalized;
+}
+
+/**
+ * Index a record of the store. Records should be added in the order they were added to the
+ * store, which makes adding them cheap, but don't have to be.
+ */
+void SearchIndex::add(int record)
+{
+        const QString title = normalize(library.title(record));
+        titles.insert(record, title);
+
+        if (record >= titleStarts.size()) {
+                titleStarts.resize(record + 1);
+                titleLengths.resize(record + 1);
+        }
+        titleStarts[record] = titleText.size();
+        titleLengths[record] = title.size();
+        titleText += title;
+
+        addInterned(artists, library.artistPool(), library.artistId(record), record);
+        addInterned(albums, library.albumPool(), library.albumId(record), record);
+}
+
+/**
+ * Stop finding a record, e.g. because it's about to change. This has to be done before the
+ * record changes in the store, as it's the old values that need removing.
+ */
+void SearchIndex::remove(int record)
+{
+        titles.erase(record, title(record).toString());
+
+        const int artist = static_cast<int>(library.artistId(record));
+        if (artist < artists.records.size()) {
+                eraseSorted(artists.records[artist], record);
+        }
+
+        const int album = static_cast<int>(library.albumId(record));
+        if (album < albums.records.size()) {
+                eraseSorted(albums.records[album], record);
+        }
+}
+
+/**
+ * Follow the store's records to where they've moved, after it's been compacted (see
+ * LibraryStore::compact()). Records that have gone are dropped from every posting list on
+ * the way, so removing a lot of records at once doesn't need remove() for each of them.
+ *
+ * The titles are packed together again on the way, which also drops the old titles of
+ * records that have changed.
+ *
+ * @param moved Where each record has moved to, or -1 if it's gone.
+ */
+void SearchIndex::remap(const QVector<int> &moved)
+{
+        titles.remap(moved);
+        for (InternedField *field : {&artists, &albums}) {
+                for (QVector<int> &records : field->records) {
+                        remapSorted(records, moved);
+                }
+        }
+
+        QString packedText;
+        QVector<int> packedStarts;
+        QVector<int> packedLengths;
+        for (int record = 0; record < moved.size() && record < titleStarts.size(); ++record) {
+                if (moved[record] < 0) {
+                        continue;
+                }
+                packedStarts.append(packedText.size());
+                packedLengths.append(titleLengths[record]);
+                packedText += title(record);
+        }
+
+        titleText.swap(packedText);
+        titleStarts.swap(packedStarts);
+        titleLengths.swap(packedLengths);
+}
+
+/**
+ * Find the records matching a query. Every word of the query has to be in the title,
+ * artist, or album of a record for it to match, though they don't all have to be in the
+ * same one.
+ *
+ * @param query What the user typed.
+ * @return Which records match, by record. Everything matches an empty query.
+ */
+QBitArray SearchIndex::find(const QString &query) const
+{
+        const QStringList words = normalize(query).split(' ', QString::SkipEmptyParts);
+
+        QBitArray matches(library.size(), true);
+        for (const QString &word : words) {
+                QBitArray found(library.size());
+
+                for (int record : titles.candidates(word)) {
+                        if (!needsChecking(word) || title(record).contains(word)) {
+                                found.setBit(record);
+                        }
+                }
+                findInterned(artists, word, found);
+                findInterned(albums, word, found);
+
+                matches &= found;
+        }
+
+        return matches;
+}
+
+/**
+ * Check just some records against a query, e.g. songs that have just been added while the
+ * library's being filtered. This looks at each of the records rather than going through
+ * the trigrams, which is quicker for a handful of records than a search of the whole
+ * library.
+ *
+ * @param query What the user typed.
+ * @param records The records to check.
+ * @param matches Where to set (or clear) each record's bit, by record.
+ */
+void SearchIndex::find(const QString &query, const QVector<int> &records, QBitArray &matches) const
+{
+        const QStringList words = normalize(query).split(' ', QString::SkipEmptyParts);
+
+        for (int record : records) {
+                const QStringRef artist(&artists.strings[static_cast<int>(library.artistId(record))]);
+                const QStringRef album(&albums.strings[static_cast<int>(library.albumId(record))]);
+
+                bool matched = true;
+                for (const QString &word : words) {
+                        if (!containsWord(title(record), word) && !containsWord(artist, word) &&
+                            !containsWord(album, word)) {
+                                matched = false;
+                                break;
+                        }
+                }
+                matches.setBit(record, matched);
+        }
+}
+
+/**
+ * Find the records that nearly match a query. Like find(), every word has to be in the
+ * title, artist, or album, but each word can be a couple of typos away from what's there
+ * (see FuzzyPattern::maxErrors()).
+ *
+ * @param query What the user typed.
+ * @return For each record, how many typos away from matching the query it is in total, or
+ *         noMatch if it doesn't match.
+ */
+QVector<quint8> SearchIndex::fuzzyFind(const QString &query) const
+{
+        const QStringList words = normalize(query).split(' ', QString::SkipEmptyParts);
+        const int count = library.size();
+
+        QVector<quint8> distances(count, 0);
+        for (const QString &word : words) {
+                const FuzzyPattern pattern(word);
+                const int maxErrors = pattern.maxErrors();
+
+                // Text shorter than this can't be close enough to the word.
+                const int shortest = pattern.length() - maxErrors;
+
+                auto closeness = [&pattern, maxErrors, shortest](const QChar *text, int length) {
+                        if (length < shortest) {
+                                return noMatch;
+                        }
+                        const int distance = pattern.distance(text, length);
+                        return distance <= maxErrors ? static_cast<quint8>(distance) : noMatch;
+                };
+
+                QVector<quint8> best(count, noMatch);
+                quint8 *titleDistances = best.data();
+                auto matchTitles = [this, &closeness, titleDistances](int first, int last) {
+                        for (int record = first; record < last; ++record) {
+                                titleDistances[record] = closeness(titleText.constData() + titleStarts[record],
+                                                                   titleLengths[record]);
+                        }
+                };
+
+                if (count < parallelThreshold) {
+                        matchTitles(0, count);
+                } else {
+                        const int chunks = workers().threadCount() * 4;
+                        const int chunkSize = (count + chunks - 1) / chunks;
+                        for (int first = 0; first < count; first += chunkSize) {
+                                workers().submit([&matchTitles, first, chunkSize, count](int) {
+                                        matchTitles(first, qMin(count, first + chunkSize));
+                                });
+                        }
+                        workers().wait();
+                }
+
+                // There are far fewer artists and albums than songs, so they're matched by
+                // string, and each record takes its string's distance.
+                for (const InternedField *field : {&artists, &albums}) {
+                        for (int id = 0; id < field->strings.size(); ++id) {
+                                const QString &text = field->strings[id];
+                                const quint8 distance = closeness(text.constData(), text.size());
+                                if (distance == noMatch) {
+                                        continue;
+                                }
+
+                                for (int record : field->records[id]) {
+                                        best[record] = qMin(best[record], distance);
+                                }
+                        }
+                }
+
+                for (int record = 0; record < count; ++record) {
+                        if (distances[record] == noMatch || best[record] == noMatch) {
+                                distances[record] = noMatch;
+                        } else {
+                                distances[record] = static_cast<quint8>(qMin(distances[record] + best[record],
+                                                                             noMatch - 1));
+                        }
+                }
+        }
+
+        return distances;
+}
+
+/**
+ * Work out how close just some records are to matching a query, like fuzzyFind() does for
+ * every record.
+ *
+ * @param query What the user typed.
+ * @param records The records to check.
+ * @param distances Where to put each record's distance, by record.
+ */
+void SearchIndex::fuzzyFind(const QString &query, const QVector<int> &records,
+                            QVector<quint8> &distances) const
+{
+        const QStringList words = normalize(query).split(' ', QString::SkipEmptyParts);
+
+        std::vector<FuzzyPattern> patterns;
+        patterns.reserve(static_cast<std::size_t>(words.size()));
+        for (const QString &word : words) {
+                patterns.emplace_back(word);
+        }
+
+        for (int record : records) {
+                const QString &artist = artists.strings[static_cast<int>(library.artistId(record))];
+                const QString &album = albums.strings[static_cast<int>(library.albumId(record))];
+
+                bool matched = true;
+                int total = 0;
+                for (const FuzzyPattern &pattern : patterns) {
+                        const int maxErrors = pattern.maxErrors();
+                        auto closeness = [&pattern, maxErrors](const QChar *text, int length) {
+                                if (length < pattern.length() - maxErrors) {
+                                        return maxErrors + 1;
+                                }
+                                return pattern.distance(text, length);
+                        };
+
+                        const int best = qMin(closeness(titleText.constData() + titleStarts[record],
+                                                        titleLengths[record]),
+                                              qMin(closeness(artist.constData(), artist.size()),
+                                                   closeness(album.constData(), album.size())));
+                        if (best > maxErrors) {
+                                matched = false;
+                                break;
+                        }
+                        total += best;
+                }
+
+                distances[record] = matched ? static_cast<quint8>(qMin(total, noMatch - 1)) : noMatch;
+        }
+}
+
+void SearchIndex::addInterned(InternedField &field, const StringPool &pool, quint32 id, int record)
+{
+        // Strings are interned in order, so any we haven't seen yet are at the end.
+        while (field.strings.size() <= static_cast<int>(id)) {
+                const int next = field.strings.size();
+                field.strings.append(normalize(pool.string(static_cast<quint32>(next))));
+                field.records.append(QVector<int>());
+                field.index.insert(next, field.strings.last());
+        }
+
+        insertSorted(field.records[static_cast<int>(id)], record);
+}
+
+void SearchIndex::findInterned(const InternedField &field, const QString &word, QBitArray &found)
+{
+        for (int id : field.index.candidates(word)) {
+                if (needsChecking(word) && !field.strings[id].contains(word)) {
+                        continue;
+                }
+
+                for (int record : field.records[id]) {
+                        found.setBit(record);
+                }
+        }
+}
+
+WorkStealingPool &SearchIndex::workers() const
+{
+        if (!pool) {
+                pool.reset(new WorkStealingPool(QThread::idealThreadCount()));
+        }
+
+        return *pool;
+}
@@ -7,59 +7,240 @@
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
 #include <id3v2tag.h>
 #include <id3v2extendedheader.h>
+#include <tpropertymap.h>
+#include <mpegproperties.h>
 #pragma GCC diagnostic pop
 
 #include <QDebug>
 
-Song::Song(const QFileInfo &t_filePath)
-        : filePath(t_filePath.absoluteFilePath())
+#include <sys/stat.h>
+
+#include "includes/library/prefetchedstream.hpp"
+
+/**
+ * Create an empty song, to be filled in with metadata that has already been read (e.g. from
+ * the library cache) without reading the file itself.
+ */
+Song::Song()
+        : year(0),
+          track(0),
+          disc(0),
+          duration(0),
+          bpm(0),
+          bitrate(0),
+          sampleRate(0),
+          device(0),
+          inode(0),
+          size(0),
+          modified(0)
+{
+
+}
+
+/**
+ * Read a song from a stream over its file (see updateMetadata()).
+ *
+ * @param stream The song's file, already open.
+ * @param properties The metadata to read on top of the basic tags.
+ * @param style How hard to try to get the duration right.
+ * @param durationEstimated If given, set to whether the duration is only an estimate.
+ */
+Song::Song(const QFileInfo &t_filePath, TagLib::IOStream &stream, Properties properties,
+           TagLib::AudioProperties::ReadStyle style, bool *durationEstimated)
+        : filePath(t_filePath.absoluteFilePath()),
+          year(0),
+          track(0),
+          disc(0),
+          duration(0),
+          bpm(0),
+          bitrate(0),
+          sampleRate(0),
+          canonicalPath(t_filePath.canonicalFilePath()),
+          device(0),
+          inode(0),
+          size(0),
+          modified(0)
+{
+        updateMetadata(stream, properties, style, durationEstimated);
+}
+
+/**
+ * @param milliseconds A duration.
+ * @return The duration as minutes and seconds, e.g. "03:25".
+ */
+QString Song::formatDuration(int milliseconds)
+{
+        const int seconds = milliseconds / 1000;
+        return QString("%1:%2")
+                .arg(seconds / 60, 2, 10, QChar('0'))
+                .arg(seconds % 60, 2, 10, QChar('0'));
+}
+
+/**
+ * @param number A year, track, or disc number.
+ * @return The number, or nothing if it isn't set.
+ */
+QString Song::formatNumber(int number)
 {
-        file = TagLib::FileRef(this->filePath.toStdString().c_str());
+        return number > 0 ? QString::number(number) : QString();
+}
 
-        updateMetadata();
+/**
+ * @param kilobits A bitrate, in kb/s.
+ * @return The bitrate with its unit, or nothing if it isn't known.
+ */
+QString Song::formatBitrate(int kilobits)
+{
+        return kilobits > 0 ? QString("%1 kbps").arg(kilobits) : QString();
 }
 
-Song::Song(const Song &other)
-        : filePath(other.filePath)
+/**
+ * @param hertz A sample rate, in Hz.
+ * @return The sample rate in kHz, e.g. "44.1 kHz", or nothing if it isn't known.
+ */
+QString Song::formatSampleRate(int hertz)
 {
-        file = TagLib::FileRef(other.filePath.toStdString().c_str());
+        return hertz > 0 ? QString("%1 kHz").arg(hertz / 1000.0) : QString();
+}
 
-        updateMetadata();
+/**
+ * Songs don't keep their file open, so that they stay cheap to copy around. Anything that
+ * needs more than the metadata a song holds (e.g. cover art, or editing the tags) can open
+ * the file with this.
+ *
+ * @return The song's file, which is closed again once the last FileRef to it is gone.
+ */
+TagLib::FileRef Song::open() const
+{
+        return TagLib::FileRef(QFile::encodeName(filePath).constData());
 }
 
-const QMap<QString, QString> &Song::getMetadata() const
+/**
+ * Read the song's metadata from its file again, along with the file's identity and the
+ * size and modification time it was read at.
+ *
+ * Most formats say how long they are in their headers, but some (e.g. a variable bitrate
+ * MP3 without a Xing header) only give an estimate there, and getting the duration right
+ * means reading further into the file. With TagLib::AudioProperties::Fast only the headers
+ * are read, and the Duration property can be read later on to fix the duration up.
+ *
+ * @param properties The metadata to read on top of the basic tags.
+ * @param style How much of the file to read for its audio properties.
+ */
+void Song::updateMetadata(Properties properties, TagLib::AudioProperties::ReadStyle style)
 {
-        return metadata;
+        const auto stream = PrefetchedStream::prefetch(QFile::encodeName(filePath));
+        updateMetadata(*stream, properties, style);
 }
 
-void Song::updateMetadata()
+/**
+ * Read the song's metadata through a stream that's already open, e.g. one that's had the
+ * ends of the file read into it ahead of time.
+ *
+ * @param durationEstimated If given, set to whether the duration was only estimated from
+ *                          the file's headers, and is worth reading properly later on.
+ */
+void Song::updateMetadata(TagLib::IOStream &stream, Properties properties,
+                          TagLib::AudioProperties::ReadStyle style, bool *durationEstimated)
 {
+        if (durationEstimated) {
+                *durationEstimated = false;
+        }
+
+        struct stat status;
+        if (stat(QFile::encodeName(filePath).constData(), &status) == 0) {
+                device = static_cast<quint64>(status.st_dev);
+                inode = static_cast<quint64>(status.st_ino);
+                size = static_cast<qint64>(status.st_size);
+                modified = static_cast<qint64>(status.st_mtime);
+        }
+
+        TagLib::FileRef file(&stream, true, style);
         if (!file.isNull() && file.tag()) {
+                title = TStringToQString(file.tag()->title());
+                artist = TStringToQString(file.tag()->artist());
+                album = TStringToQString(file.tag()->album());
+                genre = TStringToQString(file.tag()->genre());
+                year = static_cast<int>(file.tag()->year());
+                track = static_cast<int>(file.tag()->track());
+
+                // The basic tag doesn't know about discs, so it has to come from the
+                // format specific tags. It's usually stored as "disc/discs".
+                const TagLib::PropertyMap tags = file.file()->properties();
+                const TagLib::StringList discNumber = tags["DISCNUMBER"];
+                if (!discNumber.isEmpty()) {
+                        disc = TStringToQString(discNumber.front()).section('/', 0, 0).toInt();
+                }
 
-                // TODO: Use this stuff (Taglib example tagreader), as well as audioProperties
-                // TODO: Probably use it for editing tags and such later.
-                /*
-                TagLib::PropertyMap tags = file.file()->properties();
+                if (file.audioProperties()) {
+                        duration = file.audioProperties()->lengthInMilliseconds();
 
-                for (TagLib::PropertyMap::ConstIterator it = tags.begin(); it != tags.end(); ++it) {
-                    for(TagLib::StringList::ConstIterator j = it->second.begin(); j != it->second.end(); ++j) {
-                        std::cout << std::left << std::setw(10) << it->first << " - " << '"' << *j << '"' << std::endl;
-                    }
+                        // Every other format says how long it is in its headers, but an MP3
+                        // without a Xing or VBRI header only has its first frame's bitrate to
+                        // go on, which is wrong if the bitrate varies.
+                        const auto *mpeg = dynamic_cast<const TagLib::MPEG::Properties *>(file.audioProperties());
+                        if (durationEstimated && style == TagLib::AudioProperties::Fast &&
+                            mpeg != nullptr && mpeg->xingHeader() == nullptr) {
+                                *durationEstimated = true;
+                        }
+                }
+
+                readProperties(file, tags, properties);
+        }
+}
+
+/**
+ * Read just some of the metadata that's only read when it's asked for, e.g. when the user
+ * starts showing a column that wasn't being shown before, or to fix up a duration that was
+ * only estimated when the song was first read.
+ *
+ * @param properties The metadata to read.
+ * @param bytesRead If given, how much of the file was read is added to it.
+ */
+void Song::updateProperties(Properties properties, qint64 *bytesRead)
+{
+        const TagLib::AudioProperties::ReadStyle style = properties & Duration
+                                                         ? TagLib::AudioProperties::Accurate
+                                                         : TagLib::AudioProperties::Average;
+
+        const auto stream = PrefetchedStream::prefetch(QFile::encodeName(filePath));
+        TagLib::FileRef file(stream.get(), true, style);
+        if (!file.isNull() && file.tag()) {
+                readProperties(file, file.file()->properties(), properties);
+        }
+
+        if (bytesRead) {
+                *bytesRead += stream->bytesRead();
+        }
+}
+
+void Song::readProperties(const TagLib::FileRef &file, const TagLib::PropertyMap &tags,
+                          Properties properties)
+{
+        auto first = [&tags](const char *key) {
+                const TagLib::StringList values = tags[key];
+                return values.isEmpty() ? QString() : TStringToQString(values.front());
+        };
+
+        if (properties & Composer) {
+                composer = first("COMPOSER");
+        }
+        if (properties & Bpm) {
+                bpm = first("BPM").toInt();
+        }
+        if (properties & Comment) {
+                comment = TStringToQString(file.tag()->comment());
+        }
+
+        if (file.audioProperties()) {
+                if (properties & Bitrate) {
+                        bitrate = file.audioProperties()->bitrate();
+                }
+                if (properties & SampleRate) {
+                        sampleRate = file.audioProperties()->sampleRate();
+                }
+                if (properties & Duration) {
+                        duration = file.audioProperties()->lengthInMilliseconds();
                 }
-                */
-
-                metadata = {
-                        {"Title", TStringToQString(file.tag()->title())},
-                        {"Artist", TStringToQString(file.tag()->artist())},
-                        {"Album", TStringToQString(file.tag()->album())},
-                        {"Year", QString("%1").arg(file.tag()->year())},
-                        {"Track", QString("%1").arg(file.tag()->track())},
-                        {"Genre", TStringToQString(file.tag()->genre())},
-                        // TODO: Should probably change this part, what if it can't find the audio properties?
-                        {"Duration", QString("%1:%2")
-                                .arg(file.audioProperties()->length()/60, 2, 10, QChar('0'))
-                                .arg(file.audioProperties()->length()%60, 2, 10, QChar('0'))
-                        },
-                };
         }
 }
@@ -0,0 +1,88 @@
+#include "includes/library/stringpool.hpp"
+
+StringPool::StringPool()
+{
+        // The empty string.
+        offsets.append(0);
+        offsets.append(0);
+}
+
+/**
+ * Add a string to the pool, unless it's already there.
+ *
+ * @param string The string to add.
+ * @return The string's ID.
+ */
+quint32 StringPool::intern(const QString &string)
+{
+        if (string.isEmpty()) {
+                return 0;
+        }
+
+        const QByteArray encoded = string.toUtf8();
+        const auto existing = ids.constFind(encoded);
+        if (existing != ids.constEnd()) {
+                return existing.value();
+        }
+
+        const quint32 id = append(encoded);
+        ids.insert(encoded, id);
+        return id;
+}
+
+/**
+ * Add a string to the pool, even if it's already there.
+ *
+ * @param string The string to add.
+ * @return The string's ID.
+ */
+quint32 StringPool::append(const QString &string)
+{
+        if (string.isEmpty()) {
+                return 0;
+        }
+
+        return append(string.toUtf8());
+}
+
+/**
+ * Add a string from another pool to this one, even if it's already there, without decoding
+ * it on the way.
+ *
+ * @param pool The pool the string is in.
+ * @param id The string's ID in that pool.
+ * @return The string's ID in this pool.
+ */
+quint32 StringPool::copy(const StringPool &pool, quint32 id)
+{
+        if (id == 0) {
+                return 0;
+        }
+
+        const quint32 start = pool.offsets[static_cast<int>(id)];
+        return append(QByteArray::fromRawData(pool.bytes.constData() + start, pool.length(id)));
+}
+
+quint32 StringPool::append(const QByteArray &string)
+{
+        const quint32 id = static_cast<quint32>(offsets.size() - 1);
+        bytes.append(string);
+        offsets.append(static_cast<quint32>(bytes.size()));
+        return id;
+}
+
+QString StringPool::string(quint32 id) const
+{
+        const quint32 start = offsets[static_cast<int>(id)];
+        return QString::fromUtf8(bytes.constData() + start,
+                                 static_cast<int>(offsets[static_cast<int>(id) + 1] - start));
+}
+
+/**
+ * @return Roughly how many bytes the pool is using.
+ */
+int StringPool::memoryUsage() const
+{
+        return bytes.capacity() + offsets.capacity() * static_cast<int>(sizeof(quint32)) +
+               ids.size() * static_cast<int>(sizeof(quint32) + sizeof(QByteArray) + sizeof(void *) * 2);
+}
@@ -0,0 +1,152 @@
+#include "includes/library/workstealingpool.hpp"
+
+WorkStealingPool::WorkStealingPool(int threads)
+        : queued(0),
+          pending(0),
+          nextQueue(0),
+          stopping(false)
+{
+        if (threads < 1) {
+                threads = 1;
+        }
+
+        for (int i = 0; i < threads; ++i) {
+                queues.emplace_back(new Queue);
+        }
+
+        for (int i = 0; i < threads; ++i) {
+                workers.emplace_back(&WorkStealingPool::work, this, i);
+        }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+        {
+                std::lock_guard<std::mutex> lock(stateMutex);
+                stopping = true;
+        }
+        workAvailable.notify_all();
+
+        for (auto &worker : workers) {
+                worker.join();
+        }
+}
+
+/**
+ * Submit a task from outside of the pool. Tasks are spread across the workers in a
+ * round robin fashion.
+ *
+ * @param task The task to run.
+ */
+void WorkStealingPool::submit(Task task)
+{
+        const unsigned index = nextQueue++ % static_cast<unsigned>(queues.size());
+        submit(static_cast<int>(index), std::move(task));
+}
+
+/**
+ * Submit a task to a specific worker's deque. This is what tasks running inside the
+ * pool should use (with the worker index they were given), so that the work they
+ * spawn stays close to them.
+ *
+ * @param worker The worker whose deque the task should be pushed on to.
+ * @param task The task to run.
+ */
+void WorkStealingPool::submit(int worker, Task task)
+{
+        ++pending;
+
+        Queue &queue = *queues[static_cast<std::size_t>(worker)];
+        {
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                queue.tasks.push_back(std::move(task));
+        }
+
+        {
+                // Taking the lock here means a worker can't check for work and then go
+                // to sleep in between us queueing the task and notifying it.
+                std::lock_guard<std::mutex> lock(stateMutex);
+                ++queued;
+        }
+        workAvailable.notify_one();
+}
+
+/**
+ * Block until every submitted task, including any tasks they spawned, has finished.
+ */
+void WorkStealingPool::wait()
+{
+        std::unique_lock<std::mutex> lock(stateMutex);
+        allDone.wait(lock, [this]() { return pending == 0; });
+}
+
+/**
+ * Like wait(), but gives up after the given amount of time.
+ *
+ * @param milliseconds How long to wait for.
+ * @return Whether every task has finished.
+ */
+bool WorkStealingPool::waitFor(int milliseconds)
+{
+        std::unique_lock<std::mutex> lock(stateMutex);
+        return allDone.wait_for(lock, std::chrono::milliseconds(milliseconds),
+                                [this]() { return pending == 0; });
+}
+
+void WorkStealingPool::work(int worker)
+{
+        Task task;
+
+        for (;;) {
+                if (pop(worker, task) || steal(worker, task)) {
+                        task(worker);
+                        task = nullptr;
+
+                        if (--pending == 0) {
+                                std::lock_guard<std::mutex> lock(stateMutex);
+                                allDone.notify_all();
+                        }
+                        continue;
+                }
+
+                std::unique_lock<std::mutex> lock(stateMutex);
+                workAvailable.wait(lock, [this]() { return stopping || queued > 0; });
+                if (stopping && queued == 0) {
+                        return;
+                }
+        }
+}
+
+bool WorkStealingPool::pop(int worker, Task &task)
+{
+        Queue &queue = *queues[static_cast<std::size_t>(worker)];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (queue.tasks.empty()) {
+                return false;
+        }
+
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        --queued;
+        return true;
+}
+
+bool WorkStealingPool::steal(int thief, Task &task)
+{
+        const std::size_t count = queues.size();
+
+        for (std::size_t offset = 1; offset < count; ++offset) {
+                Queue &queue = *queues[(static_cast<std::size_t>(thief) + offset) % count];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+
+                if (!queue.tasks.empty()) {
+                        task = std::move(queue.tasks.front());
+                        queue.tasks.pop_front();
+                        --queued;
+                        return true;
+                }
+        }
+
+        return false;
+}
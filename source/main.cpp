@@ -4,6 +4,10 @@
 int main(int argc, char *argv[])
 {
         QApplication a(argc, argv);
+        // Project is defined in CMakeLists.txt, and is used by QSettings to find our settings.
+        QApplication::setApplicationName(Project);
+        QApplication::setOrganizationName(Project);
+
         PlayerWindow w;
         w.show();
 
@@ -25,6 +25,7 @@ MenuBar::~MenuBar()
 {
         delete fileMenu;
         delete controlsMenu;
+        delete viewMenu;
 }
 
 QList<QMenu *> &MenuBar::getAllMenus()
@@ -36,9 +37,11 @@ void MenuBar::setUpMenus()
 {
         fileMenu = new QMenu("&File");
         controlsMenu = new QMenu("Controls");
+        viewMenu = new QMenu("View");
 
         menus.append(fileMenu);
         menus.append(controlsMenu);
+        menus.append(viewMenu);
 }
 
 void MenuBar::setUpActions()
@@ -48,6 +51,24 @@ void MenuBar::setUpActions()
         connect(scanDir, &QAction::triggered,
                 this, &MenuBar::libraryScanDirectory);
 
+        rescan = new QAction("Rescan Library");
+        connect(rescan, &QAction::triggered,
+                this, &MenuBar::rescanLibrary);
+
+        pauseScanning = new QAction("Pause Scan");
+        pauseScanning->setEnabled(false);
+        connect(pauseScanning, &QAction::triggered,
+                this, &MenuBar::pauseOrResumeScan);
+
+        cancelScanning = new QAction("Cancel Scan");
+        cancelScanning->setEnabled(false);
+        connect(cancelScanning, &QAction::triggered,
+                this, &MenuBar::cancelScan);
+
+        sortAlbums = new QAction("Sort By Album");
+        connect(sortAlbums, &QAction::triggered,
+                this, &MenuBar::sortByAlbum);
+
         previousSong = new QAction("Previous Song");
         previousSong->setShortcut(Qt::Key_F4);
         connect(previousSong, &QAction::triggered,
@@ -68,10 +89,15 @@ void MenuBar::setUpActions()
 void MenuBar::connectActions()
 {
         fileMenu->addAction(scanDir);
+        fileMenu->addAction(rescan);
+        fileMenu->addAction(pauseScanning);
+        fileMenu->addAction(cancelScanning);
 
         controlsMenu->addAction(previousSong);
         controlsMenu->addAction(playPause);
         controlsMenu->addAction(nextSong);
+
+        viewMenu->addAction(sortAlbums);
 }
 
 void MenuBar::playOrPause()
@@ -107,3 +133,24 @@ void MenuBar::libraryScanDirectory()
 {
         emit updateLibrary();
 }
+
+void MenuBar::pauseOrResumeScan()
+{
+        if (pauseScanning->text() == "Pause Scan") {
+                pauseScanning->setText("Resume Scan");
+                emit pauseScan();
+        } else {
+                pauseScanning->setText("Pause Scan");
+                emit resumeScan();
+        }
+}
+
+/**
+ * The scan actions only make sense while there's a scan running.
+ */
+void MenuBar::scanningChanged(bool scanning)
+{
+        pauseScanning->setText("Pause Scan");
+        pauseScanning->setEnabled(scanning);
+        cancelScanning->setEnabled(scanning);
+}
@@ -3,18 +3,27 @@
 #include "includes/metadataeditordialog.hpp"
 
 RightClickMenu::RightClickMenu(QWidget *parent)
-        : QMenu(parent),
-          selectedSong(QFileInfo("/dev/null"))
+        : QMenu(parent)
 {
         playAction = new QAction("Play this");
         connect(playAction, &QAction::triggered,
                 this, &RightClickMenu::playThisNow);
         addAction(playAction);
 
+        playNextAction = new QAction("Play next");
+        connect(playNextAction, &QAction::triggered,
+                this, &RightClickMenu::playThisNext);
+        addAction(playNextAction);
+
         editMetadataAction = new QAction("Edit metadata");
         connect(editMetadataAction, &QAction::triggered,
                 this, &RightClickMenu::editMetadata);
         addAction(editMetadataAction);
+
+        removeAction = new QAction("Remove from library");
+        connect(removeAction, &QAction::triggered,
+                this, &RightClickMenu::removeFromLibrary);
+        addAction(removeAction);
 }
 
 RightClickMenu::~RightClickMenu()
@@ -27,16 +27,15 @@ MetadataEditorDialog::~MetadataEditorDialog()
         delete ui;
 }
 
-void MetadataEditorDialog::setupMetadata(Song &song)
+void MetadataEditorDialog::setupMetadata(const Song &t_song)
 {
-        metadata = song.getMetadata();
-        file = song.filePath;
-        ui->songTitleTextbox->setText(metadata["Title"]);
-        ui->artistTextbox->setText(metadata["Artist"]);
-        ui->albumTextbox->setText(metadata["Album"]);
-        ui->trackTextbox->setText(metadata["Track"]);
-        ui->genreTextbox->setText(metadata["Genre"]);
-        ui->yearTextbox->setText(metadata["Year"]);
+        song = t_song;
+        ui->songTitleTextbox->setText(song.title);
+        ui->artistTextbox->setText(song.artist);
+        ui->albumTextbox->setText(song.album);
+        ui->trackTextbox->setText(Song::formatNumber(song.track));
+        ui->genreTextbox->setText(song.genre);
+        ui->yearTextbox->setText(Song::formatNumber(song.year));
 
         ui->trackErrorLabel->setStyleSheet("color: red");
         ui->yearErrorLabel->setStyleSheet("color: red");
@@ -63,7 +62,7 @@ void MetadataEditorDialog::setupMetadata(Song &song)
 
 void MetadataEditorDialog::albumTextChanged(const QString &)
 {
-        if (ui->albumTextbox->text() == metadata["Album"]) {
+        if (ui->albumTextbox->text() == song.album) {
                 UNEDIT(AlbumText);
                 return;
         }
@@ -75,7 +74,7 @@ void MetadataEditorDialog::trackTextChanged(const QString &newText)
 {
         bool converted = false;
 
-        if (newText == metadata["Track"]) {
+        if (newText == Song::formatNumber(song.track)) {
                 UNEDIT(TrackText);
                 ui->trackErrorLabel->setText("");
                 return;
@@ -95,7 +94,7 @@ void MetadataEditorDialog::trackTextChanged(const QString &newText)
 
 void MetadataEditorDialog::artistTextChanged(const QString &newText)
 {
-        if (newText == metadata["Artist"]) {
+        if (newText == song.artist) {
                 UNEDIT(ArtistText);
                 return;
         }
@@ -105,7 +104,7 @@ void MetadataEditorDialog::artistTextChanged(const QString &newText)
 
 void MetadataEditorDialog::genreTextChanged(const QString &newText)
 {
-        if (newText == metadata["Genre"]) {
+        if (newText == song.genre) {
                 UNEDIT(GenreText);
                 return;
         }
@@ -115,7 +114,7 @@ void MetadataEditorDialog::genreTextChanged(const QString &newText)
 
 void MetadataEditorDialog::songTitleTextChanged(const QString &newText)
 {
-        if (newText == metadata["Title"]) {
+        if (newText == song.title) {
                 UNEDIT(TitleText);
                 return;
         }
@@ -127,7 +126,7 @@ void MetadataEditorDialog::yearTextChanged(const QString &newText)
 {
         bool converted = false;
 
-        if (newText == metadata["Year"]) {
+        if (newText == Song::formatNumber(song.year)) {
                 UNEDIT(YearText);
                 return;
         }
@@ -154,7 +153,7 @@ void MetadataEditorDialog::save()
                 return;
         }
 
-        TagLib::FileRef songFile(file.toStdString().c_str());
+        TagLib::FileRef songFile = song.open();
 
         if (edits & ArtistText) {
                 songFile.tag()->setArtist(QStringToTString(ui->artistTextbox->text()));
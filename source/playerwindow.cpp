@@ -4,15 +4,21 @@
 #include <QMediaMetaData>
 #include <QMimeDatabase>
 #include <QHBoxLayout>
+#include <QHeaderView>
+#include <QItemSelectionModel>
 #include <QTableView>
+#include <QLineEdit>
 #include <QLabel>
+#include <QMenu>
 
 #include "includes/controls/durationcontrols.hpp"
 #include "includes/controls/playercontrols.hpp"
 #include "includes/controls/volumecontrols.hpp"
+#include "includes/library/librarycolumns.hpp"
 #include "includes/library/librarymodel.hpp"
 #include "includes/menus/rightclickmenu.hpp"
 #include "includes/library/libraryview.hpp"
+#include "includes/library/playlist.hpp"
 #include "includes/trackinformation.hpp"
 #include "includes/menus/menubar.hpp"
 #include "includes/coverartlabel.hpp"
@@ -36,7 +42,6 @@
  * TODO: Fixes
  *  - Fix up UI stuff (Most is done, just got to fix the gap between the cover art and the library)
  *  - Add other tags to columns in the library view (Partly done)
- *  - Fix the Playlist problems (playing next, previous crashes, change playlist set-up)
  *  - Set up a namespace that everything can connect to
  *      - Audio stuff
  *        - Global media player
@@ -72,6 +77,9 @@ PlayerWindow::PlayerWindow(QWidget *parent)
         coverArtLabel = new CoverArtLabel(this);
         library = new LibraryModel;
         libraryView = new LibraryView(this, library);
+        searchBox = new QLineEdit(this);
+        searchBox->setPlaceholderText("Search");
+        searchBox->setClearButtonEnabled(true);
 
         rightClickMenu = new RightClickMenu(this);
 
@@ -91,9 +99,7 @@ PlayerWindow::~PlayerWindow()
 
 void PlayerWindow::nextSong()
 {
-        if (!Astoria::getAudioInstance()->playlist()->isEmpty()) {
-                Astoria::getAudioInstance()->playlist()->next();
-        }
+        Astoria::getPlaylistInstance()->next();
 }
 
 /*
@@ -106,9 +112,7 @@ void PlayerWindow::previousSong()
         // TODO: What to do if the user has pressed go to previous and there aren't any songs
         // TODO: before it? Do we set position to 0, and pause the media? Or just reset the song?
         QMediaPlayer *player = Astoria::getAudioInstance();
-        if (player->position() < 10000 && player->playlist()->currentIndex() > 0) {
-                player->playlist()->previous();
-        } else {
+        if (player->position() >= 10000 || !Astoria::getPlaylistInstance()->previous()) {
                 player->setPosition(0);
         }
 }
@@ -145,22 +149,39 @@ void PlayerWindow::metaDataChanged()
  */
 void PlayerWindow::play()
 {
-        if (!Astoria::getPlaylistInstance()->isEmpty()) {
-                emit Astoria::getAudioInstance()->play();
+        Playlist *playlist = Astoria::getPlaylistInstance();
+        if (playlist->currentIndex() < 0 && !playlist->setCurrentIndex(0)) {
+                return;
         }
+
+        emit Astoria::getAudioInstance()->play();
 }
 
 /**
- * Play a song right now.
+ * Play a song right now. If it's already in the playlist, the playlist jumps to it, and
+ * otherwise it's added after the current song and played from there.
  */
 void PlayerWindow::playNow()
 {
-        // TODO: Fix this.
-        Astoria::getPlaylistInstance()->insertMedia(0, library->get(libraryView->currentIndex().row()));
-        Astoria::getPlaylistInstance()->setCurrentIndex(0);
+        const QString path = library->get(libraryView->currentIndex().row()).toLocalFile();
+        Playlist *playlist = Astoria::getPlaylistInstance();
+        if (!playlist->jumpTo(path)) {
+                playlist->playNext(QStringList(path));
+                playlist->setCurrentIndex(playlist->currentIndex() + 1);
+        }
+
         emit Astoria::getAudioInstance()->play();
 }
 
+/**
+ * Queue a song up to play after the current one.
+ */
+void PlayerWindow::playNext()
+{
+        const QString path = library->get(libraryView->currentIndex().row()).toLocalFile();
+        Astoria::getPlaylistInstance()->playNext(QStringList(path));
+}
+
 /**
  * When the user clicks on the library, we want to show them a menu that they can use.
  * @param pos Where the user clicked.
@@ -174,6 +195,39 @@ void PlayerWindow::customMenuRequested(QPoint pos)
         }
 }
 
+/**
+ * Let the user pick which columns the library is shown with.
+ */
+void PlayerWindow::headerMenuRequested(QPoint pos)
+{
+        QMenu columnMenu;
+        for (int column = 0; column < LibraryColumns::count; ++column) {
+                QAction *action = columnMenu.addAction(LibraryColumns::all[column].header);
+                action->setCheckable(true);
+                action->setChecked(library->isColumnShown(column));
+                action->setData(column);
+        }
+
+        QAction *chosen = columnMenu.exec(libraryView->horizontalHeader()->viewport()->mapToGlobal(pos));
+        if (chosen) {
+                library->setColumnShown(chosen->data().toInt(), chosen->isChecked());
+        }
+}
+
+/**
+ * Remove the songs the user has selected from the library, or the song at the current row
+ * if nothing's selected.
+ */
+void PlayerWindow::removeSelected()
+{
+        QModelIndexList selected = libraryView->selectionModel()->selectedRows();
+        if (selected.isEmpty() && libraryView->currentIndex().isValid()) {
+                selected.append(libraryView->currentIndex());
+        }
+
+        library->removeSongs(selected);
+}
+
 void PlayerWindow::updatePlaylist()
 {
         // TODO: Figure out what to do here
@@ -206,6 +260,20 @@ void PlayerWindow::setupConnections()
                 this, SLOT(previousSong()));
         connect(menu, SIGNAL(updateLibrary()),
                 library, SLOT(openDirectory()));
+        connect(menu, SIGNAL(rescanLibrary()),
+                library, SLOT(rescanLibrary()));
+        connect(menu, SIGNAL(sortByAlbum()),
+                library, SLOT(sortByAlbum()));
+        connect(menu, SIGNAL(pauseScan()),
+                library, SLOT(pauseScan()));
+        connect(menu, SIGNAL(resumeScan()),
+                library, SLOT(resumeScan()));
+        connect(menu, SIGNAL(cancelScan()),
+                library, SLOT(cancelScan()));
+        connect(library, SIGNAL(scanningChanged(bool)),
+                menu, SLOT(scanningChanged(bool)));
+        connect(player, SIGNAL(stateChanged(QMediaPlayer::State)),
+                library, SLOT(playbackStateChanged(QMediaPlayer::State)));
 
         connect(library, SIGNAL(libraryUpdated()),
                 this, SLOT(updatePlaylist()));
@@ -219,13 +287,23 @@ void PlayerWindow::setupConnections()
                 this, SLOT(customMenuRequested(QPoint)));
         connect(libraryView->horizontalHeader(), SIGNAL(sectionClicked(int)),
                 library, SLOT(sortByColumn(int)));
+        connect(libraryView->horizontalHeader(), SIGNAL(customContextMenuRequested(QPoint)),
+                this, SLOT(headerMenuRequested(QPoint)));
+        connect(searchBox, SIGNAL(textChanged(QString)),
+                library, SLOT(setFilter(QString)));
         connect(libraryView, SIGNAL(doubleClicked(const QModelIndex &)),
                 this, SLOT(playNow()));
 
         connect(rightClickMenu, SIGNAL(playThisNow()),
                 this, SLOT(playNow()));
+        connect(rightClickMenu, SIGNAL(playThisNext()),
+                this, SLOT(playNext()));
         connect(rightClickMenu, SIGNAL(updateLibrary()),
                 library, SLOT(updateMetadata()));
+        connect(rightClickMenu, SIGNAL(removeFromLibrary()),
+                this, SLOT(removeSelected()));
+        connect(libraryView, SIGNAL(removeRequested()),
+                this, SLOT(removeSelected()));
 
         connect(this, SIGNAL(songChanged(TagLib::FileRef)),
                 coverArtLabel, SLOT(artChanged(TagLib::FileRef)));
@@ -264,9 +342,14 @@ void PlayerWindow::setupUI()
         coverArtArea->addSpacing(1);
         coverArtArea->addWidget(coverArtLabel);
 
+        QVBoxLayout *libraryLayout = new QVBoxLayout;
+        libraryLayout->addWidget(searchBox);
+        libraryLayout->addWidget(libraryView, 1);
+        libraryLayout->setContentsMargins(0, 0, 0, 0);
+
         QHBoxLayout *uiLayout = new QHBoxLayout;
         uiLayout->addLayout(coverArtArea);
-        uiLayout->addWidget(libraryView, 1);
+        uiLayout->addLayout(libraryLayout, 1);
         uiLayout->setContentsMargins(0, 0, 0, 0);
 
         QVBoxLayout *endLayout = new QVBoxLayout;
@@ -279,6 +362,7 @@ void PlayerWindow::setupUI()
 
 void PlayerWindow::closeEvent(QCloseEvent *event)
 {
+        library->saveCache();
         Astoria::deInit();
         QMainWindow::closeEvent(event);
 }
@@ -0,0 +1,79 @@
+#include <QTemporaryDir>
+#include <QFile>
+#include <QtTest>
+
+#include "includes/library/librarycache.hpp"
+#include "includes/library/librarystore.hpp"
+
+/**
+ * Makes sure a damaged cache is turned away, rather than read past the end of.
+ */
+class LibraryCacheTest : public QObject
+{
+Q_OBJECT
+
+private slots:
+        void opensSavedCache();
+        void rejectsTruncatedCache();
+
+private:
+        QByteArray savedCache(const QString &fileName) const;
+
+        QTemporaryDir directory;
+};
+
+QByteArray LibraryCacheTest::savedCache(const QString &fileName) const
+{
+        LibraryStore songs;
+        for (int i = 0; i < 3; ++i) {
+                Song song;
+                song.filePath = QString("/music/Artist/Album/%1 - Song.flac").arg(i + 1);
+                song.canonicalPath = song.filePath;
+                song.title = QString("Song %1").arg(i + 1);
+                song.artist = "Artist";
+                song.album = "Album";
+                song.track = i + 1;
+                songs.append(song);
+        }
+
+        if (!LibraryCache::save(fileName, songs)) {
+                return QByteArray();
+        }
+
+        QFile file(fileName);
+        file.open(QIODevice::ReadOnly);
+        return file.readAll();
+}
+
+void LibraryCacheTest::opensSavedCache()
+{
+        const QString fileName = directory.filePath("whole.cache");
+        QVERIFY(!savedCache(fileName).isEmpty());
+
+        LibraryCache cache(fileName);
+        QVERIFY(cache.open());
+        QCOMPARE(cache.count(), 3);
+}
+
+void LibraryCacheTest::rejectsTruncatedCache()
+{
+        const QByteArray whole = savedCache(directory.filePath("source.cache"));
+        QVERIFY(!whole.isEmpty());
+
+        // Inside the header, on the first record's length, inside its fixed fields and its
+        // path, and one byte short of the end.
+        const QList<int> lengths{ 2, 18, 30, 50, whole.length() / 2, whole.length() - 1 };
+        for (int length : lengths) {
+                const QString fileName = directory.filePath(QString("truncated-%1.cache").arg(length));
+                QFile file(fileName);
+                QVERIFY(file.open(QIODevice::WriteOnly));
+                file.write(whole.left(length));
+                file.close();
+
+                LibraryCache cache(fileName);
+                QVERIFY2(!cache.open(), qPrintable(QString("Truncated to %1 bytes").arg(length)));
+        }
+}
+
+QTEST_GUILESS_MAIN(LibraryCacheTest)
+#include "librarycachetest.moc"